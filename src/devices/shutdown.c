@@ -5,14 +5,25 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/mtrace.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/pagedir.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/loadctl.h"
+#include "vm/swap.h"
+#include "vm/vmstat.h"
+#include "vm/zswap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -130,6 +141,16 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  mtrace_dump ();
+#ifdef VM
+  vm_frame_print_stats ();
+  vm_swap_print_stats ();
+  vm_zswap_print_stats ();
+  vm_stat_print ();
+  vm_loadctl_print_stats ();
+#endif
 #ifdef FILESYS
   block_print_stats ();
 #endif
@@ -137,5 +158,6 @@ print_stats (void)
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  pagedir_print_stats ();
 #endif
 }
@@ -0,0 +1,6 @@
+#ifndef __LIB_KERNEL_STDLIB_H
+#define __LIB_KERNEL_STDLIB_H
+
+/* The kernel's allocator is declared in threads/malloc.h. */
+
+#endif /* lib/kernel/stdlib.h */
@@ -0,0 +1,10 @@
+#ifndef __LIB_MADVISE_H
+#define __LIB_MADVISE_H
+
+/* Access pattern hints for the madvise system call. */
+#define MADV_NORMAL     0       /* No special treatment. */
+#define MADV_SEQUENTIAL 2       /* Read ahead, and drop pages once used. */
+#define MADV_WILLNEED   3       /* Bring the pages in now. */
+#define MADV_DONTNEED   4       /* Discard the pages' contents. */
+
+#endif /* lib/madvise.h */
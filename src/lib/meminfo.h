@@ -0,0 +1,39 @@
+#ifndef __LIB_MEMINFO_H
+#define __LIB_MEMINFO_H
+
+#include <stddef.h>
+
+/* Maximum number of malloc() size classes reported. */
+#define MEMINFO_MALLOC_CLASSES 10
+
+/* Snapshot of kernel memory usage, filled in by the meminfo
+   system call.  Page counts are in units of PGSIZE. */
+struct meminfo
+  {
+    /* Page allocator pools. */
+    size_t kernel_free;                 /* Free pages in kernel pool. */
+    size_t kernel_used;                 /* Used pages in kernel pool. */
+    size_t user_free;                   /* Free pages in user pool. */
+    size_t user_used;                   /* Used pages in user pool. */
+
+    /* malloc() size classes. */
+    size_t malloc_class_cnt;            /* Number of valid classes. */
+    size_t malloc_block_size[MEMINFO_MALLOC_CLASSES]; /* Block size. */
+    size_t malloc_bytes[MEMINFO_MALLOC_CLASSES];      /* Bytes in use. */
+    size_t malloc_arenas[MEMINFO_MALLOC_CLASSES];     /* Arena pages. */
+    size_t malloc_big_pages;            /* Pages in big blocks. */
+
+    /* Virtual memory. */
+    size_t frame_cnt;                   /* Frames in the frame table. */
+    size_t frame_pinned;                /* Pinned frames. */
+    size_t swap_used;                   /* Swap slots in use. */
+    size_t swap_total;                  /* Swap slots on the device. */
+    size_t resident_pages;              /* Calling process's resident pages. */
+    size_t large_promotions;            /* Page tables made 4 MB pages. */
+    size_t large_demotions;             /* 4 MB pages split back. */
+    size_t zswap_pool_pages;            /* Compressed swap pool size. */
+    size_t zswap_pages;                 /* Pages held compressed. */
+    size_t zswap_bytes;                 /* Their compressed size. */
+  };
+
+#endif /* lib/meminfo.h */
@@ -19,4 +19,8 @@ void *binary_search (const void *key, const void *array, size_t cnt,
                      int (*compare) (const void *, const void *, void *aux),
                      void *aux);
 
+/* Include lib/user/stdlib.h or lib/kernel/stdlib.h, as
+   appropriate. */
+#include_next <stdlib.h>
+
 #endif /* lib/stdlib.h */
@@ -28,7 +28,16 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_MEMINFO,                /* Reports kernel memory usage. */
+    SYS_FORK,                   /* Duplicates the current process. */
+    SYS_MSYNC,                  /* Writes back a memory mapping. */
+    SYS_MADVISE,                /* Hints at a range's access pattern. */
+    SYS_VMSTAT,                 /* Reports page fault statistics. */
+    SYS_SETRSS,                 /* Limits the resident set. */
+    SYS_SBRK                    /* Moves the program break. */
   };
 
 #endif /* lib/syscall-nr.h */
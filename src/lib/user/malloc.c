@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A size-class implementation of malloc() on top of sbrk().
+
+   Requests of up to 2 kB are rounded up to a power of 2, at
+   least 16 bytes, and served from the free list of that size
+   class.  When the list is empty, a block is cut from the
+   class's current chunk, a run of CHUNK_SIZE bytes obtained from
+   sbrk().  Blocks are cut one at a time, so the pages of a chunk
+   are not touched, and thus not faulted in, until they are
+   needed.  Freed blocks go back to their class's free list.
+
+   Bigger requests are rounded up to whole pages, header
+   included.  They are served first-fit from a list of freed big
+   blocks, or else by moving the break.  A freed big block that
+   ends at the break is given back to the kernel.
+
+   Every block is preceded by a header that records its size, so
+   that free() and realloc() know where it belongs.
+
+   User processes have a single thread, so no locking is
+   needed. */
+
+/* Page size, as the kernel uses it for the heap. */
+#define PAGE_SIZE 4096
+
+/* Smallest and largest size class, and the number of them. */
+#define MIN_SHIFT 4
+#define MAX_SHIFT 11
+#define CLASS_CNT (MAX_SHIFT - MIN_SHIFT + 1)
+
+/* Bytes obtained from sbrk() at a time for small blocks. */
+#define CHUNK_SIZE (4 * PAGE_SIZE)
+
+/* Magic number for detecting corrupted or foreign blocks. */
+#define BLOCK_MAGIC 0x6d616c6c
+
+/* Header before each block. */
+struct header
+  {
+    unsigned magic;             /* Always BLOCK_MAGIC. */
+    size_t size;                /* Bytes usable in the block. */
+  };
+
+/* Free block, on a free list. */
+struct free_block
+  {
+    struct free_block *next;    /* Next free block of the list. */
+  };
+
+/* Size class. */
+struct class
+  {
+    struct free_block *free;    /* Free blocks. */
+    uint8_t *next;              /* Uncut part of the current chunk. */
+    uint8_t *end;               /* End of the current chunk. */
+  };
+
+static struct class classes[CLASS_CNT];
+
+/* Freed big blocks, most recently freed first. */
+static struct free_block *big_free;
+
+static struct header *header_of (void *);
+static void *alloc_small (size_t cls);
+static void *alloc_big (size_t size);
+static void free_big (struct header *);
+
+/* Obtains and returns a new block of at least SIZE bytes, or a
+   null pointer if memory is not available. */
+void *
+malloc (size_t size) 
+{
+  size_t cls;
+
+  if (size == 0)
+    return NULL;
+  if (size > (1u << MAX_SHIFT))
+    return alloc_big (size);
+
+  for (cls = 0; (1u << (cls + MIN_SHIFT)) < size; cls++)
+    continue;
+  return alloc_small (cls);
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) 
+{
+  void *p;
+  size_t size;
+
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+  return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) 
+{
+  void *new_block;
+  size_t old_size;
+
+  if (new_size == 0) 
+    {
+      free (old_block);
+      return NULL;
+    }
+  if (old_block == NULL)
+    return malloc (new_size);
+
+  /* Blocks are rounded up, so the block may already be big
+     enough. */
+  old_size = header_of (old_block)->size;
+  if (new_size <= old_size)
+    return old_block;
+
+  new_block = malloc (new_size);
+  if (new_block != NULL)
+    {
+      memcpy (new_block, old_block, old_size);
+      free (old_block);
+    }
+  return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) 
+{
+  struct header *h;
+  size_t cls;
+
+  if (p == NULL)
+    return;
+
+  h = header_of (p);
+  if (h->size > (1u << MAX_SHIFT))
+    {
+      free_big (h);
+      return;
+    }
+
+  for (cls = 0; (1u << (cls + MIN_SHIFT)) < h->size; cls++)
+    continue;
+  ((struct free_block *) p)->next = classes[cls].free;
+  classes[cls].free = p;
+}
+
+/* Returns the header of block P, checking that it is one. */
+static struct header *
+header_of (void *p) 
+{
+  struct header *h = (struct header *) p - 1;
+
+  ASSERT (h->magic == BLOCK_MAGIC);
+  return h;
+}
+
+/* Returns a block of size class CLS, or a null pointer if
+   memory is not available. */
+static void *
+alloc_small (size_t cls) 
+{
+  struct class *c = &classes[cls];
+  size_t size = 1u << (cls + MIN_SHIFT);
+  struct header *h;
+
+  /* Fast path: reuse a freed block. */
+  if (c->free != NULL)
+    {
+      struct free_block *b = c->free;
+      c->free = b->next;
+      return b;
+    }
+
+  if (c->end - c->next < (ptrdiff_t) (sizeof *h + size))
+    {
+      uint8_t *chunk = sbrk (CHUNK_SIZE);
+      if (chunk == (void *) -1)
+        return NULL;
+      c->next = chunk;
+      c->end = chunk + CHUNK_SIZE;
+    }
+
+  h = (struct header *) c->next;
+  c->next += sizeof *h + size;
+  h->magic = BLOCK_MAGIC;
+  h->size = size;
+  return h + 1;
+}
+
+/* Returns a block of at least SIZE bytes, more than the largest
+   size class, or a null pointer if memory is not available. */
+static void *
+alloc_big (size_t size) 
+{
+  size_t total = ROUND_UP (sizeof (struct header) + size, PAGE_SIZE);
+  struct free_block **bp;
+  struct header *h;
+
+  if (total < size)
+    return NULL;
+
+  for (bp = &big_free; *bp != NULL; bp = &(*bp)->next)
+    {
+      h = header_of (*bp);
+      if (h->size >= size)
+        {
+          *bp = (*bp)->next;
+          return h + 1;
+        }
+    }
+
+  h = sbrk (total);
+  if (h == (void *) -1)
+    return NULL;
+  h->magic = BLOCK_MAGIC;
+  h->size = total - sizeof *h;
+  return h + 1;
+}
+
+/* Frees big block H.  If it ends at the break, its pages go back
+   to the kernel; otherwise it is kept for reuse. */
+static void
+free_big (struct header *h) 
+{
+  uint8_t *end = (uint8_t *) (h + 1) + h->size;
+  struct free_block *b = (struct free_block *) (h + 1);
+
+  if (end == sbrk (0))
+    {
+      h->magic = 0;
+      sbrk (-(intptr_t) (sizeof *h + h->size));
+      return;
+    }
+  b->next = big_free;
+  big_free = b;
+}
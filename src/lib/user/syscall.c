@@ -182,3 +182,56 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+meminfo (struct meminfo *info)
+{
+  return syscall1 (SYS_MEMINFO, info);
+}
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+bool
+msync (mapid_t mapid)
+{
+  return syscall1 (SYS_MSYNC, mapid);
+}
+
+bool
+madvise (void *addr, size_t length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+bool
+vmstat (struct vmstat *info)
+{
+  return syscall1 (SYS_VMSTAT, info);
+}
+
+bool
+setrss (pid_t pid, size_t pages)
+{
+  return syscall2 (SYS_SETRSS, pid, pages);
+}
+
+/* Moves the program break by INCREMENT bytes and returns the old
+   break, or (void *) -1 on failure. */
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+/* Sets the program break to END. */
+bool
+brk (void *end)
+{
+  uint8_t *cur = sbrk (0);
+
+  return sbrk ((uint8_t *) end - cur) != (void *) -1;
+}
@@ -2,7 +2,11 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <debug.h>
+#include <madvise.h>
+#include <meminfo.h>
+#include <vmstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +49,14 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool meminfo (struct meminfo *);
+pid_t fork (void);
+bool msync (mapid_t);
+bool madvise (void *addr, size_t length, int advice);
+bool vmstat (struct vmstat *);
+bool setrss (pid_t, size_t pages);
+void *sbrk (intptr_t increment);
+bool brk (void *end);
+
 #endif /* lib/user/syscall.h */
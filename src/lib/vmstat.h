@@ -0,0 +1,57 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+/* Page fault classes, by how the fault was resolved. */
+enum vmstat_fault
+  {
+    VMSTAT_FAULT_ZERO,          /* Zero-filled or mapped the zero page. */
+    VMSTAT_FAULT_SWAP,          /* Read back from swap. */
+    VMSTAT_FAULT_FILE,          /* Read from a file. */
+    VMSTAT_FAULT_STACK,         /* Grew the stack. */
+    VMSTAT_FAULT_COW,           /* Write to a shared or zero page. */
+    VMSTAT_FAULT_MINOR,         /* Page resident already, or shared text. */
+    VMSTAT_FAULT_KILL,          /* Invalid access, process killed. */
+    VMSTAT_FAULT_CNT
+  };
+
+/* Eviction victims, by the kind of page. */
+enum vmstat_evict
+  {
+    VMSTAT_EVICT_ANON,          /* Stack, heap and other anonymous pages. */
+    VMSTAT_EVICT_FILE,          /* Writable pages of files and mappings. */
+    VMSTAT_EVICT_TEXT,          /* Shared program text, dropped. */
+    VMSTAT_EVICT_CNT
+  };
+
+/* Fault latency histogram: bucket I counts the faults that took
+   fewer than 2**(VMSTAT_HIST_SHIFT + I) CPU cycles and at least
+   half as many.  The first bucket also holds faster faults, the
+   last one slower ones. */
+#define VMSTAT_HIST_SHIFT 10
+#define VMSTAT_HIST_BUCKETS 16
+
+/* Page fault counts and latencies. */
+struct vmstat_faults
+  {
+    unsigned cnt[VMSTAT_FAULT_CNT];
+    unsigned hist[VMSTAT_FAULT_CNT][VMSTAT_HIST_BUCKETS];
+  };
+
+/* Virtual memory statistics, filled in by the vmstat system call. */
+struct vmstat
+  {
+    struct vmstat_faults process;       /* Calling process's faults. */
+    struct vmstat_faults global;        /* Faults of all processes. */
+
+    unsigned evict_cnt[VMSTAT_EVICT_CNT]; /* Evictions by victim. */
+    unsigned evict_dirty;               /* Victims dirty when evicted. */
+    unsigned long long clock_scanned;   /* Frames the clock looked at. */
+    unsigned clock_scan_max;            /* Most for one eviction. */
+
+    unsigned rss;                       /* Frames charged to the calling process. */
+    unsigned rss_limit;                 /* Its limit, 0 if none. */
+    unsigned rss_evict;                 /* Its pages evicted to keep to it. */
+    unsigned rss_evict_global;          /* The same, for all processes. */
+  };
+
+#endif /* lib/vmstat.h */
@@ -0,0 +1,60 @@
+/* Forks with 2 MB of data, more than fits in user memory, and
+   has parent and child each rewrite all of it, so that frames
+   shared after fork() are evicted to swap and read back before
+   or after being copied.  Checks that each process sees only
+   its own writes. */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define WORDS (SIZE / sizeof (uint32_t))
+
+static uint32_t buf[WORDS];
+
+static void
+fill (uint32_t key)
+{
+  size_t i;
+
+  for (i = 0; i < WORDS; i++)
+    buf[i] = i * key;
+}
+
+static void
+check (uint32_t key, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < WORDS; i++)
+    if (buf[i] != i * key)
+      fail ("%s: word %zu is %"PRIu32", expected %"PRIu32,
+            who, i, buf[i], (uint32_t) (i * key));
+}
+
+void
+test_main (void)
+{
+  pid_t pid;
+
+  fill (3);
+  msg ("parent filled buffer");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      check (3, "child");
+      fill (5);
+      check (5, "child");
+      exit (42);
+    }
+
+  fill (7);
+  CHECK (pid != PID_ERROR, "fork");
+  CHECK (wait (pid) == 42, "wait for child");
+  check (7, "parent");
+  msg ("parent and child saw private copies");
+}
@@ -0,0 +1,73 @@
+/* Forks, then has parent and child each write a data page, a
+   bss page and a stack page that they shared after fork(), and
+   checks that each sees only its own writes. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define WORDS (4096 / sizeof (int))
+
+static int data_page[WORDS] = {1};
+static int bss_page[WORDS];
+
+static void
+fill (int *page, int value)
+{
+  size_t i;
+
+  for (i = 0; i < WORDS; i++)
+    page[i] = value;
+}
+
+static void
+check (const int *page, int value, const char *who, const char *what)
+{
+  size_t i;
+
+  for (i = 0; i < WORDS; i++)
+    if (page[i] != value)
+      fail ("%s: word %zu of %s page is %d, expected %d",
+            who, i, what, page[i], value);
+}
+
+static void
+fill_all (int *stack_page, int value)
+{
+  fill (data_page, value);
+  fill (bss_page, value);
+  fill (stack_page, value);
+}
+
+static void
+check_all (const int *stack_page, int value, const char *who)
+{
+  check (data_page, value, who, "data");
+  check (bss_page, value, who, "bss");
+  check (stack_page, value, who, "stack");
+}
+
+void
+test_main (void)
+{
+  int stack_page[WORDS];
+  pid_t pid;
+
+  fill_all (stack_page, 1);
+  msg ("parent filled pages");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      check_all (stack_page, 1, "child");
+      fill_all (stack_page, 2);
+      check_all (stack_page, 2, "child");
+      exit (42);
+    }
+
+  fill_all (stack_page, 3);
+  CHECK (pid != PID_ERROR, "fork");
+  CHECK (wait (pid) == 42, "wait for child");
+  check_all (stack_page, 3, "parent");
+  msg ("parent and child saw private copies");
+}
@@ -0,0 +1,63 @@
+/* Discards pages with madvise(MADV_DONTNEED).  An anonymous heap
+   page must read back as zeros.  A page of a mapped file must be
+   written back first and then read again from the file. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE_SIZE 4096
+
+/* Discards the page at PAGE and checks that it lost its frame. */
+static void
+discard (void *page, const char *what)
+{
+  struct meminfo before, after;
+
+  meminfo (&before);
+  CHECK (madvise (page, PAGE_SIZE, MADV_DONTNEED), "discard %s", what);
+  meminfo (&after);
+  if (after.resident_pages >= before.resident_pages)
+    fail ("%s still resident: %zu pages before, %zu after",
+          what, before.resident_pages, after.resident_pages);
+}
+
+void
+test_main (void)
+{
+  size_t size = strlen (sample);
+  char buf[1024];
+  char *heap;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  /* Anonymous page. */
+  heap = sbrk (2 * PAGE_SIZE);
+  CHECK (heap != (void *) -1, "grow heap by two pages");
+  heap = (char *) (((uintptr_t) heap + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+  memset (heap, 0xcc, PAGE_SIZE);
+  discard (heap, "anonymous page");
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (heap[i] != 0)
+      fail ("byte %zu of discarded page is %02hhx, not 0", i, heap[i]);
+  msg ("anonymous page reads as zeros");
+
+  /* File page. */
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (!memcmp (ACTUAL, sample, size), "mapping holds file data");
+  memcpy (ACTUAL, "XXXX", 4);
+  discard (ACTUAL, "file page");
+  CHECK (!memcmp (ACTUAL, "XXXX", 4) && !memcmp (ACTUAL + 4, sample + 4, size - 4),
+         "file page read back with its writes");
+  read (handle, buf, size);
+  CHECK (!memcmp (buf, "XXXX", 4), "writes reached the file");
+
+  munmap (map);
+  close (handle);
+}
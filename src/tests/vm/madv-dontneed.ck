@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madv-dontneed) begin
+(madv-dontneed) grow heap by two pages
+(madv-dontneed) discard anonymous page
+(madv-dontneed) anonymous page reads as zeros
+(madv-dontneed) open "sample.txt"
+(madv-dontneed) mmap "sample.txt"
+(madv-dontneed) mapping holds file data
+(madv-dontneed) discard file page
+(madv-dontneed) file page read back with its writes
+(madv-dontneed) writes reached the file
+(madv-dontneed) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Maps a file of several pages without touching it and calls
+   madvise(MADV_WILLNEED) on the mapping, which must bring all of
+   its pages in at once.  Then checks that they hold the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE_SIZE 4096
+#define PAGES 8
+
+void
+test_main (void)
+{
+  static char page[PAGE_SIZE];
+  struct meminfo before, after;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK (create ("willneed.dat", PAGES * PAGE_SIZE), "create \"willneed.dat\"");
+  CHECK ((handle = open ("willneed.dat")) > 1, "open \"willneed.dat\"");
+  for (i = 0; i < PAGES; i++)
+    {
+      memset (page, 'a' + i, PAGE_SIZE);
+      if (write (handle, page, PAGE_SIZE) != PAGE_SIZE)
+        fail ("write of page %zu failed", i);
+    }
+  msg ("write %d pages", PAGES);
+
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"willneed.dat\"");
+  meminfo (&before);
+  CHECK (madvise (ACTUAL, PAGES * PAGE_SIZE, MADV_WILLNEED), "madvise WILLNEED");
+  meminfo (&after);
+  if (after.resident_pages < before.resident_pages + PAGES)
+    fail ("%zu pages resident before, %zu after",
+          before.resident_pages, after.resident_pages);
+  msg ("all pages resident");
+
+  for (i = 0; i < PAGES * PAGE_SIZE; i++)
+    if (ACTUAL[i] != (char) ('a' + i / PAGE_SIZE))
+      fail ("byte %zu of mapping is %02hhx", i, ACTUAL[i]);
+  msg ("pages hold file data");
+
+  munmap (map);
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madv-willneed) begin
+(madv-willneed) create "willneed.dat"
+(madv-willneed) open "willneed.dat"
+(madv-willneed) write 8 pages
+(madv-willneed) mmap "willneed.dat"
+(madv-willneed) madvise WILLNEED
+(madv-willneed) all pages resident
+(madv-willneed) pages hold file data
+(madv-willneed) end
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Checks that malloc() reuses freed blocks within each size
+   class, that realloc() keeps a block's contents, and that a
+   big block freed at the top of the heap moves the break back
+   down. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const size_t sizes[] = {1, 16, 17, 100, 1000, 2048};
+
+void
+test_main (void)
+{
+  uint8_t *p, *q, *r, *brk0;
+  size_t i;
+
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      p = malloc (sizes[i]);
+      if (p == NULL)
+        fail ("malloc(%zu) failed", sizes[i]);
+      memset (p, 0xcc, sizes[i]);
+      free (p);
+      q = malloc (sizes[i]);
+      if (q != p)
+        fail ("freed block of %zu bytes not reused", sizes[i]);
+      free (q);
+    }
+  msg ("freed blocks reused in every size class");
+
+  p = malloc (20);
+  CHECK (p != NULL, "malloc 20 bytes");
+  for (i = 0; i < 20; i++)
+    p[i] = i;
+  CHECK ((q = realloc (p, 32)) == p, "realloc within size class");
+  CHECK ((r = realloc (q, 300)) != NULL, "realloc to larger size class");
+  for (i = 0; i < 20; i++)
+    if (r[i] != i)
+      fail ("byte %zu is %d after realloc, expected %zu", i, r[i], i);
+  msg ("realloc kept contents");
+  CHECK (malloc (32) == q, "block freed by realloc reused");
+
+  brk0 = sbrk (0);
+  CHECK ((p = malloc (10000)) != NULL, "malloc 10000 bytes");
+  CHECK ((uint8_t *) sbrk (0) > brk0, "big block extends heap");
+  memset (p, 0x5a, 10000);
+  free (p);
+  CHECK (sbrk (0) == brk0, "freed big block returned at break");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(malloc-reuse) begin
+(malloc-reuse) freed blocks reused in every size class
+(malloc-reuse) malloc 20 bytes
+(malloc-reuse) realloc within size class
+(malloc-reuse) realloc to larger size class
+(malloc-reuse) realloc kept contents
+(malloc-reuse) block freed by realloc reused
+(malloc-reuse) malloc 10000 bytes
+(malloc-reuse) big block extends heap
+(malloc-reuse) freed big block returned at break
+(malloc-reuse) end
+EOF
+pass;
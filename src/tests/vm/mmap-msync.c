@@ -0,0 +1,44 @@
+/* Writes to a file through a mapping and calls msync, then reads
+   the data in the file back using the read system call while the
+   mapping is still in place.  Writes again, to check that a page
+   written back once is written back after it is dirtied again. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+void
+test_main (void)
+{
+  size_t size = strlen (sample);
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("sample.txt", size), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+
+  /* Dirty, msync, read back. */
+  memcpy (ACTUAL, sample, size);
+  CHECK (msync (map), "msync \"sample.txt\"");
+  read (handle, buf, size);
+  CHECK (!memcmp (buf, sample, size),
+         "compare read data against written data");
+
+  /* Dirty the same page again. */
+  memset (ACTUAL, 'x', 16);
+  CHECK (msync (map), "msync \"sample.txt\" again");
+  seek (handle, 0);
+  read (handle, buf, size);
+  CHECK (!memcmp (buf, ACTUAL, size),
+         "compare read data against rewritten data");
+
+  munmap (map);
+  CHECK (!msync (map), "msync of unmapped mapping fails");
+  close (handle);
+}
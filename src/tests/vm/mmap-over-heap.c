@@ -0,0 +1,26 @@
+/* Verifies that mapping over the heap is disallowed. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  uint8_t *heap;
+  int handle;
+  size_t i;
+
+  CHECK ((heap = sbrk (2 * 4096)) != (void *) -1, "grow heap by two pages");
+  memset (heap, 0xa5, 2 * 4096);
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (handle, heap) == MAP_FAILED, "try to mmap over heap");
+  CHECK (mmap (handle, heap + 4096) == MAP_FAILED,
+         "try to mmap over last heap page");
+  for (i = 0; i < 2 * 4096; i++)
+    if (heap[i] != 0xa5)
+      fail ("heap byte %zu changed to %d", i, heap[i]);
+  msg ("heap unchanged");
+}
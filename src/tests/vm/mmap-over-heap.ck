@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-over-heap) begin
+(mmap-over-heap) grow heap by two pages
+(mmap-over-heap) open "sample.txt"
+(mmap-over-heap) try to mmap over heap
+(mmap-over-heap) try to mmap over last heap page
+(mmap-over-heap) heap unchanged
+(mmap-over-heap) end
+EOF
+pass;
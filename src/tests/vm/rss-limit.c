@@ -0,0 +1,48 @@
+/* Limits its own resident set, touches more pages than the limit
+   allows, and checks that its own pages were evicted to stay
+   within the limit and read back intact.  Also checks that a
+   process cannot raise or lift its own limit. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include <vmstat.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LIMIT 16
+#define PAGES 64
+#define PAGE_SIZE 4096
+
+static char buf[PAGES * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  struct vmstat st;
+  unsigned evicted;
+  size_t i;
+
+  CHECK (setrss (0, LIMIT), "limit resident set to %d pages", LIMIT);
+  CHECK (!setrss (0, 2 * LIMIT), "raising own limit fails");
+  CHECK (!setrss (0, 0), "lifting own limit fails");
+  CHECK (!setrss (-5, LIMIT), "limiting a process not a child fails");
+
+  CHECK (vmstat (&st), "vmstat");
+  evicted = st.rss_evict;
+
+  for (i = 0; i < PAGES; i++)
+    buf[i * PAGE_SIZE] = i;
+
+  CHECK (vmstat (&st), "vmstat");
+  CHECK (st.rss_limit == LIMIT, "limit is %d pages", LIMIT);
+  if (st.rss > LIMIT)
+    fail ("%u pages resident, over the limit", st.rss);
+  if (st.rss_evict <= evicted)
+    fail ("no own pages evicted");
+  msg ("own pages evicted to stay within limit");
+
+  for (i = 0; i < PAGES; i++)
+    if (buf[i * PAGE_SIZE] != (char) i)
+      fail ("page %zu reads %d", i, buf[i * PAGE_SIZE]);
+  msg ("pages read back intact");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rss-limit) begin
+(rss-limit) limit resident set to 16 pages
+(rss-limit) raising own limit fails
+(rss-limit) lifting own limit fails
+(rss-limit) limiting a process not a child fails
+(rss-limit) vmstat
+(rss-limit) vmstat
+(rss-limit) limit is 16 pages
+(rss-limit) own pages evicted to stay within limit
+(rss-limit) pages read back intact
+(rss-limit) end
+EOF
+pass;
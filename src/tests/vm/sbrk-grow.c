@@ -0,0 +1,42 @@
+/* Grows the heap with sbrk(), writes and reads the new pages,
+   shrinks it back, and verifies that pages given back read as
+   zeros when the heap grows again and that the break cannot
+   drop below the start of the heap. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (3 * 4096 + 100)
+
+void
+test_main (void)
+{
+  uint8_t *base, *p;
+  size_t i;
+
+  CHECK ((base = sbrk (0)) != (void *) -1, "sbrk(0)");
+  CHECK (sbrk (SIZE) == base, "grow heap by %d bytes", SIZE);
+  CHECK (sbrk (0) == base + SIZE, "break moved up");
+
+  for (i = 0; i < SIZE; i++)
+    base[i] = i % 251;
+  for (i = 0; i < SIZE; i++)
+    if (base[i] != i % 251)
+      fail ("byte %zu of heap is %d, expected %d", i, base[i], (int) (i % 251));
+  msg ("heap holds what was written");
+
+  CHECK (sbrk (-SIZE) == base + SIZE, "shrink heap by %d bytes", SIZE);
+  CHECK (sbrk (0) == base, "break moved down");
+
+  CHECK ((p = sbrk (4096)) == base, "grow heap by one page");
+  for (i = 0; i < 4096; i++)
+    if (p[i] != 0)
+      fail ("byte %zu of regrown heap page is %d, not 0", i, p[i]);
+  msg ("regrown page reads as zeros");
+  CHECK (sbrk (-4096) == base + 4096, "shrink heap by one page");
+
+  CHECK (sbrk (-1) == (void *) -1, "shrink below start of heap");
+  CHECK (sbrk (0) == base, "break unchanged");
+}
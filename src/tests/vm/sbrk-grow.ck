@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk-grow) begin
+(sbrk-grow) sbrk(0)
+(sbrk-grow) grow heap by 12388 bytes
+(sbrk-grow) break moved up
+(sbrk-grow) heap holds what was written
+(sbrk-grow) shrink heap by 12388 bytes
+(sbrk-grow) break moved down
+(sbrk-grow) grow heap by one page
+(sbrk-grow) regrown page reads as zeros
+(sbrk-grow) shrink heap by one page
+(sbrk-grow) shrink below start of heap
+(sbrk-grow) break unchanged
+(sbrk-grow) end
+EOF
+pass;
@@ -19,6 +19,7 @@
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/mtrace.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
@@ -33,8 +34,10 @@
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/loadctl.h"
 #include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
@@ -62,13 +65,23 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef VM
+/* -rss: Resident page limit of each process, 0 for none. */
+static size_t rss_limit;
+#endif
+
 static void bss_init (void);
 static void paging_init (void);
+static bool cpu_has_pge (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
+#ifdef VM
+static void parse_watermarks (char *value);
+static void parse_evict_policy (const char *value);
+#endif
 
 #ifdef FILESYS
 static void locate_block_devices (void);
@@ -94,6 +107,9 @@ main (void)
      then enable console locking. */
   thread_init ();
   console_init ();  
+#ifdef VM
+  thread_current ()->rss_limit = rss_limit;
+#endif
 
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
@@ -101,11 +117,13 @@ main (void)
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
+  mtrace_init ();
   malloc_init ();
   paging_init ();
 
 #ifdef VM
   vm_frame_init();
+  vm_page_init();
 #endif
 
   /* Segmentation. */
@@ -137,6 +155,9 @@ main (void)
 #endif
 #ifdef VM
   vm_swap_init();
+  vm_frame_reclaim_init();
+  vm_frame_flush_init();
+  vm_loadctl_init();
 #endif
   printf ("Boot complete.\n");
   
@@ -171,6 +192,8 @@ paging_init (void)
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  bool pge = cpu_has_pge ();
+  uint32_t cr4;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -188,7 +211,10 @@ paging_init (void)
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      /* Kernel mappings are the same in every page directory, so
+         they can stay in the TLB across context switches. */
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text)
+                    | (pge ? PTE_G : 0);
     }
 
   /* Store the physical address of the page directory into CR3
@@ -197,6 +223,27 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Honor PTE_G, and allow 4 MB pages in page directories, which
+     the VM system uses for large, fully populated user regions.
+     See [IA32-v3a] 3.6.1 "Paging Options". */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (pge)
+    cr4 |= CR4_PGE;
+#ifdef VM
+  cr4 |= CR4_PSE;
+#endif
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+}
+
+/* Returns true if the CPU supports global pages. */
+static bool
+cpu_has_pge (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & CPUID_PGE) != 0;
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -267,9 +314,23 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-mtrace"))
+        mtrace_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-wm"))
+        parse_watermarks (value);
+      else if (!strcmp (name, "-zswap"))
+        vm_zswap_pool_pages = atoi (value);
+      else if (!strcmp (name, "-rss"))
+        rss_limit = atoi (value);
+      else if (!strcmp (name, "-evict"))
+        parse_evict_policy (value);
+      else if (!strcmp (name, "-ws"))
+        vm_frame_ws_window = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -288,6 +349,37 @@ parse_options (char **argv)
   return argv;
 }
 
+#ifdef VM
+/* Parses VALUE, of the form LOW,HIGH, as the free user frame
+   watermarks of the page reclaim daemon. */
+static void
+parse_watermarks (char *value)
+{
+  char *save_ptr;
+  char *low = value != NULL ? strtok_r (value, ",", &save_ptr) : NULL;
+  char *high = low != NULL ? strtok_r (NULL, ",", &save_ptr) : NULL;
+
+  if (high == NULL)
+    PANIC ("-wm requires LOW,HIGH (use -h for help)");
+  vm_frame_low_wm = atoi (low);
+  vm_frame_high_wm = atoi (high);
+  if (vm_frame_low_wm == 0 || vm_frame_high_wm < vm_frame_low_wm)
+    PANIC ("-wm: need 0 < LOW <= HIGH");
+}
+
+/* Parses VALUE as the page replacement policy. */
+static void
+parse_evict_policy (const char *value)
+{
+  if (value != NULL && !strcmp (value, "clock"))
+    vm_frame_wsclock = false;
+  else if (value != NULL && !strcmp (value, "wsclock"))
+    vm_frame_wsclock = true;
+  else
+    PANIC ("-evict requires clock or wsclock (use -h for help)");
+}
+#endif
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -303,6 +395,13 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints the allocation call-site trace. */
+static void
+run_mtrace (char **argv UNUSED)
+{
+  mtrace_dump ();
+}
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -320,6 +419,7 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+      {"mtrace", 1, run_mtrace},
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
@@ -368,6 +468,7 @@ usage (void)
 #else
           "  run TEST           Run TEST.\n"
 #endif
+          "  mtrace             Print allocation call sites (with -mtrace).\n"
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
@@ -390,8 +491,16 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -mtrace            Trace allocation call sites.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -wm=LOW,HIGH       Reclaim frames below LOW free until HIGH free.\n"
+          "  -zswap=PAGES       Keep up to PAGES pages of compressed swap (0=off).\n"
+          "  -rss=PAGES         Limit each process to PAGES resident pages (0=off).\n"
+          "  -evict=POLICY      Replace pages by POLICY: clock (default) or wsclock.\n"
+          "  -ws=TICKS          Set the WSClock working-set window to TICKS.\n"
 #endif
           );
   shutdown_power_off ();
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/mtrace.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -41,6 +42,8 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    size_t arena_cnt;           /* Number of arenas. */
+    size_t used_cnt;            /* Number of blocks in use. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -64,8 +67,13 @@ struct block
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Big blocks. */
+static struct lock big_lock;    /* Protects big_page_cnt. */
+static size_t big_page_cnt;     /* Pages held by big blocks. */
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *malloc_untraced (size_t);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -82,12 +90,24 @@ malloc_init (void)
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
+  lock_init (&big_lock);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = malloc_untraced (size);
+  mtrace_alloc (p, size, __builtin_return_address (0), MTRACE_MALLOC);
+  return p;
+}
+
+/* Does the work of malloc() without reporting the allocation to
+   the allocation tracer, so that callers can report their own
+   call site. */
+static void *
+malloc_untraced (size_t size) 
 {
   struct desc *d;
   struct block *b;
@@ -107,7 +127,7 @@ malloc (size_t size)
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = palloc_get_multiple (PAL_NOTRACE, page_cnt);
       if (a == NULL)
         return NULL;
 
@@ -116,6 +136,10 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+
+      lock_acquire (&big_lock);
+      big_page_cnt += page_cnt;
+      lock_release (&big_lock);
       return a + 1;
     }
 
@@ -127,7 +151,7 @@ malloc (size_t size)
       size_t i;
 
       /* Allocate a page. */
-      a = palloc_get_page (0);
+      a = palloc_get_page (PAL_NOTRACE);
       if (a == NULL) 
         {
           lock_release (&d->lock);
@@ -138,6 +162,7 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
+      d->arena_cnt++;
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
@@ -149,6 +174,7 @@ malloc (size_t size)
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
+  d->used_cnt++;
   lock_release (&d->lock);
   return b;
 }
@@ -167,9 +193,10 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = malloc_untraced (size);
   if (p != NULL)
     memset (p, 0, size);
+  mtrace_alloc (p, size, __builtin_return_address (0), MTRACE_MALLOC);
 
   return p;
 }
@@ -201,7 +228,9 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = malloc_untraced (new_size);
+      mtrace_alloc (new_block, new_size, __builtin_return_address (0),
+                    MTRACE_MALLOC);
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -223,6 +252,8 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
+
+      mtrace_free (p);
       
       if (d != NULL) 
         {
@@ -237,6 +268,7 @@ free (void *p)
 
           /* Add block to free list. */
           list_push_front (&d->free_list, &b->free_elem);
+          d->used_cnt--;
 
           /* If the arena is now entirely unused, free it. */
           if (++a->free_cnt >= d->blocks_per_arena) 
@@ -250,6 +282,7 @@ free (void *p)
                   list_remove (&b->free_elem);
                 }
               palloc_free_page (a);
+              d->arena_cnt--;
             }
 
           lock_release (&d->lock);
@@ -257,12 +290,49 @@ free (void *p)
       else
         {
           /* It's a big block.  Free its pages. */
+          lock_acquire (&big_lock);
+          big_page_cnt -= a->free_cnt;
+          lock_release (&big_lock);
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
 
+/* Fills in the malloc() fields of INFO.  The descriptor locks
+   are not taken, so the result is only a snapshot. */
+void
+malloc_get_meminfo (struct meminfo *info)
+{
+  size_t i;
+
+  info->malloc_class_cnt = desc_cnt;
+  for (i = 0; i < desc_cnt && i < MEMINFO_MALLOC_CLASSES; i++)
+    {
+      struct desc *d = &descs[i];
+      info->malloc_block_size[i] = d->block_size;
+      info->malloc_bytes[i] = d->used_cnt * d->block_size;
+      info->malloc_arenas[i] = d->arena_cnt;
+    }
+  info->malloc_big_pages = big_page_cnt;
+}
+
+/* Prints malloc() statistics.  Each size class is shown as
+   BLOCK-SIZE:BYTES-IN-USE/ARENAS. */
+void
+malloc_print_stats (void)
+{
+  struct meminfo info;
+  size_t i;
+
+  malloc_get_meminfo (&info);
+  printf ("Malloc:");
+  for (i = 0; i < info.malloc_class_cnt; i++)
+    printf (" %zu:%zu/%zu", info.malloc_block_size[i],
+            info.malloc_bytes[i], info.malloc_arenas[i]);
+  printf (" big:%zu pages\n", info.malloc_big_pages);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -0,0 +1,372 @@
+#include "threads/mtrace.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Allocation call-site tracer.
+
+   When enabled with the -mtrace kernel command-line option,
+   malloc() and palloc() report every allocation here along with
+   the return address of the allocator call, and the matching
+   free functions report every release.  Two side tables are
+   kept:
+
+   - The live table maps each outstanding block to its call
+     site, requested size, and the tid of the thread that
+     allocated it.
+
+   - The site table accumulates, per call site, the bytes that
+     are still live and the number of allocations ever made.
+
+   mtrace_dump() prints the call sites holding the most live
+   memory and the ones allocating most often.  The addresses can
+   be translated into function names with the `backtrace'
+   utility.
+
+   Both tables are open-addressed hash tables of fixed size,
+   allocated from the kernel pool before tracing is switched on,
+   so that tracing never recurses into the allocators it
+   observes.  Allocations that do not fit are counted as
+   dropped.  Interrupts are disabled while the tables are
+   accessed, because palloc_free_page() is called from the
+   scheduler with interrupts off. */
+
+/* Per-call-site totals. */
+struct site
+  {
+    void *caller;               /* Return address, null if unused. */
+    enum mtrace_kind kind;      /* Allocator called. */
+    size_t live_bytes;          /* Bytes currently allocated. */
+    size_t live_cnt;            /* Blocks currently allocated. */
+    unsigned long long alloc_cnt; /* Allocations ever made. */
+  };
+
+/* A live allocation. */
+struct live
+  {
+    void *ptr;                  /* Allocated block, null if unused. */
+    struct site *site;          /* Call site. */
+    size_t size;                /* Bytes requested. */
+    tid_t tid;                  /* Allocating thread. */
+  };
+
+/* Table sizes. */
+#define LIVE_PAGES 16
+#define SITE_PAGES 4
+#define LIVE_CNT (LIVE_PAGES * PGSIZE / sizeof (struct live))
+#define SITE_CNT (SITE_PAGES * PGSIZE / sizeof (struct site))
+
+/* Number of entries printed in each section of a dump. */
+#define TOP_CNT 10
+
+/* -mtrace: Record allocation call sites? */
+bool mtrace_enabled;
+
+static struct live *live_table;  /* Live allocations. */
+static size_t live_used;         /* Occupied live table slots. */
+static struct site *site_table;  /* Call sites. */
+static size_t site_used;         /* Occupied site table slots. */
+
+static int64_t start_ticks;             /* Time tracing started. */
+static unsigned long long dropped_cnt;  /* Allocations not recorded. */
+
+static size_t live_lookup (void *ptr);
+static void live_remove (size_t idx);
+static struct site *site_lookup (void *caller, enum mtrace_kind);
+
+/* Allocates the side tables and starts tracing, if tracing was
+   requested on the command line.  Must be called after
+   palloc_init(). */
+void
+mtrace_init (void)
+{
+  if (!mtrace_enabled)
+    return;
+
+  mtrace_enabled = false;
+  live_table = palloc_get_multiple (PAL_ZERO, LIVE_PAGES);
+  site_table = palloc_get_multiple (PAL_ZERO, SITE_PAGES);
+  if (live_table == NULL || site_table == NULL)
+    PANIC ("mtrace: out of memory for side tables");
+
+  start_ticks = timer_ticks ();
+  mtrace_enabled = true;
+}
+
+/* Records that the allocator of type KIND returned block PTR of
+   SIZE bytes to the code at return address CALLER. */
+void
+mtrace_alloc (void *ptr, size_t size, void *caller, enum mtrace_kind kind)
+{
+  enum intr_level old_level;
+  struct site *s;
+  size_t idx;
+
+  if (!mtrace_enabled || ptr == NULL)
+    return;
+
+  old_level = intr_disable ();
+  s = site_lookup (caller, kind);
+  idx = live_lookup (ptr);
+  if (live_table[idx].ptr == ptr)
+    {
+      /* Stale entry for a block whose release we missed. */
+      live_table[idx].site->live_bytes -= live_table[idx].size;
+      live_table[idx].site->live_cnt--;
+      live_remove (idx);
+      live_used--;
+      idx = live_lookup (ptr);
+    }
+  if (s == NULL || live_used >= LIVE_CNT * 3 / 4)
+    dropped_cnt++;
+  else
+    {
+      struct live *l = &live_table[idx];
+      l->ptr = ptr;
+      l->site = s;
+      l->size = size;
+      l->tid = thread_current ()->tid;
+      live_used++;
+
+      s->live_bytes += size;
+      s->live_cnt++;
+      s->alloc_cnt++;
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that block PTR was freed.  Blocks that were never
+   recorded are ignored. */
+void
+mtrace_free (void *ptr)
+{
+  enum intr_level old_level;
+  size_t idx;
+
+  if (!mtrace_enabled || ptr == NULL)
+    return;
+
+  old_level = intr_disable ();
+  idx = live_lookup (ptr);
+  if (live_table[idx].ptr == ptr)
+    {
+      struct live *l = &live_table[idx];
+      l->site->live_bytes -= l->size;
+      l->site->live_cnt--;
+      live_remove (idx);
+      live_used--;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns true if site A holds more live bytes than site B. */
+static bool
+more_live_bytes (const struct site *a, const struct site *b)
+{
+  return a->live_bytes > b->live_bytes;
+}
+
+/* Returns true if site A allocated more often than site B. */
+static bool
+more_allocs (const struct site *a, const struct site *b)
+{
+  return a->alloc_cnt > b->alloc_cnt;
+}
+
+/* Copies the (up to) TOP_CNT sites that come first according to
+   BEFORE into TOP, best first, and returns how many were
+   copied. */
+static size_t
+select_top (struct site top[],
+            bool (*before) (const struct site *, const struct site *))
+{
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < SITE_CNT; i++)
+    {
+      const struct site *s = &site_table[i];
+      size_t j;
+
+      if (s->caller == NULL
+          || (cnt == TOP_CNT && !before (s, &top[cnt - 1])))
+        continue;
+      if (cnt < TOP_CNT)
+        cnt++;
+      for (j = cnt - 1; j > 0 && before (s, &top[j - 1]); j--)
+        top[j] = top[j - 1];
+      top[j] = *s;
+    }
+  return cnt;
+}
+
+/* Returns a short name for allocator KIND. */
+static const char *
+kind_name (enum mtrace_kind kind)
+{
+  switch (kind)
+    {
+    case MTRACE_MALLOC:
+      return "malloc";
+    case MTRACE_KERNEL_PAGE:
+      return "kpage";
+    case MTRACE_USER_PAGE:
+      return "upage";
+    default:
+      NOT_REACHED ();
+    }
+}
+
+/* Prints the call sites holding the most live memory, the call
+   sites allocating at the highest rate, and the live memory of
+   the first TOP_CNT threads found in the live table.  Does
+   nothing unless tracing is enabled. */
+void
+mtrace_dump (void)
+{
+  struct site by_bytes[TOP_CNT], by_rate[TOP_CNT];
+  struct { tid_t tid; size_t bytes; } threads[TOP_CNT];
+  size_t bytes_cnt, rate_cnt, thread_cnt = 0;
+  size_t live_cnt, site_cnt;
+  unsigned long long dropped;
+  int64_t elapsed;
+  enum intr_level old_level;
+  size_t i, j;
+
+  if (!mtrace_enabled)
+    return;
+
+  /* Take a consistent snapshot, then print it with interrupts
+     on. */
+  old_level = intr_disable ();
+  bytes_cnt = select_top (by_bytes, more_live_bytes);
+  rate_cnt = select_top (by_rate, more_allocs);
+  for (i = 0; i < LIVE_CNT; i++)
+    {
+      const struct live *l = &live_table[i];
+      if (l->ptr == NULL)
+        continue;
+      for (j = 0; j < thread_cnt && threads[j].tid != l->tid; j++)
+        continue;
+      if (j == thread_cnt)
+        {
+          if (thread_cnt == TOP_CNT)
+            continue;
+          threads[thread_cnt].tid = l->tid;
+          threads[thread_cnt++].bytes = 0;
+        }
+      threads[j].bytes += l->size;
+    }
+  live_cnt = live_used;
+  site_cnt = site_used;
+  dropped = dropped_cnt;
+  intr_set_level (old_level);
+
+  elapsed = timer_elapsed (start_ticks);
+  if (elapsed <= 0)
+    elapsed = 1;
+
+  printf ("Mtrace: %zu live blocks from %zu call sites, "
+          "%llu allocations dropped\n", live_cnt, site_cnt, dropped);
+  printf ("Mtrace: top call sites by live bytes:\n");
+  for (i = 0; i < bytes_cnt; i++)
+    printf ("  %p %-6s %8zu bytes in %zu blocks\n",
+            by_bytes[i].caller, kind_name (by_bytes[i].kind),
+            by_bytes[i].live_bytes, by_bytes[i].live_cnt);
+  printf ("Mtrace: top call sites by allocation rate:\n");
+  for (i = 0; i < rate_cnt; i++)
+    printf ("  %p %-6s %8llu allocations, %llu/s\n",
+            by_rate[i].caller, kind_name (by_rate[i].kind),
+            by_rate[i].alloc_cnt,
+            by_rate[i].alloc_cnt * TIMER_FREQ / elapsed);
+  printf ("Mtrace: live bytes by thread:\n");
+  for (i = 0; i < thread_cnt; i++)
+    printf ("  tid %d: %zu bytes\n", threads[i].tid, threads[i].bytes);
+}
+
+/* Returns the home slot of PTR in the live table. */
+static size_t
+live_hash (void *ptr)
+{
+  return hash_int ((int) ptr) % LIVE_CNT;
+}
+
+/* Returns the index of the live table slot holding PTR, or of the
+   empty slot where PTR would be inserted.  If the table has no
+   empty slot and no slot holds PTR, returns the index of an
+   occupied slot. */
+static size_t
+live_lookup (void *ptr)
+{
+  size_t idx = live_hash (ptr);
+  size_t probes;
+
+  for (probes = 0; probes < LIVE_CNT; probes++)
+    {
+      if (live_table[idx].ptr == ptr || live_table[idx].ptr == NULL)
+        break;
+      idx = (idx + 1) % LIVE_CNT;
+    }
+  return idx;
+}
+
+/* Empties live table slot IDX, moving later entries of the same
+   probe sequence back so that lookups keep working without
+   tombstones. */
+static void
+live_remove (size_t idx)
+{
+  size_t next = idx;
+
+  for (;;)
+    {
+      size_t home;
+
+      live_table[idx].ptr = NULL;
+      do
+        {
+          next = (next + 1) % LIVE_CNT;
+          if (live_table[next].ptr == NULL)
+            return;
+          home = live_hash (live_table[next].ptr);
+        }
+      while (idx <= next
+             ? idx < home && home <= next
+             : idx < home || home <= next);
+      live_table[idx] = live_table[next];
+      idx = next;
+    }
+}
+
+/* Returns the site table entry for CALLER, creating it for
+   allocator KIND if necessary, or a null pointer if the table
+   is full. */
+static struct site *
+site_lookup (void *caller, enum mtrace_kind kind)
+{
+  size_t idx = hash_int ((int) caller) % SITE_CNT;
+
+  for (;;)
+    {
+      struct site *s = &site_table[idx];
+      if (s->caller == caller)
+        return s;
+      if (s->caller == NULL)
+        {
+          if (site_used >= SITE_CNT * 3 / 4)
+            return NULL;
+          s->caller = caller;
+          s->kind = kind;
+          site_used++;
+          return s;
+        }
+      idx = (idx + 1) % SITE_CNT;
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef THREADS_MTRACE_H
+#define THREADS_MTRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Allocator that handed out a traced block. */
+enum mtrace_kind
+  {
+    MTRACE_MALLOC,              /* malloc() and friends. */
+    MTRACE_KERNEL_PAGE,         /* palloc() from the kernel pool. */
+    MTRACE_USER_PAGE            /* palloc() from the user pool. */
+  };
+
+/* -mtrace: Record allocation call sites? */
+extern bool mtrace_enabled;
+
+void mtrace_init (void);
+void mtrace_alloc (void *, size_t size, void *caller, enum mtrace_kind);
+void mtrace_free (void *);
+void mtrace_dump (void);
+
+#endif /* threads/mtrace.h */
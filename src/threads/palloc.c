@@ -7,7 +7,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/mtrace.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -31,6 +33,7 @@ struct pool
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t free_cnt;                    /* Pages clear in used_map. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +42,11 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *get_pages (enum palloc_flags, size_t page_cnt, size_t align,
+                        void *caller);
+static size_t scan_aligned (struct pool *, size_t page_cnt, size_t align);
+static void pool_get_stats (const struct pool *, size_t *free_cnt,
+                            size_t *used_cnt);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -69,6 +77,36 @@ palloc_init (size_t user_page_limit)
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  return get_pages (flags, page_cnt, 1, __builtin_return_address (0));
+}
+
+/* Like palloc_get_multiple(), but the physical address of the
+   first page returned is a multiple of ALIGN pages. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align)
+{
+  return get_pages (flags, page_cnt, align, __builtin_return_address (0));
+}
+
+/* Obtains a single free page and returns its kernel virtual
+   address.
+   If PAL_USER is set, the page is obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the page is filled with zeros.  If no pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_page (enum palloc_flags flags) 
+{
+  return get_pages (flags, 1, 1, __builtin_return_address (0));
+}
+
+/* Does the work of palloc_get_aligned(), reporting the
+   allocation to the allocation tracer as made from CALLER. */
+static void *
+get_pages (enum palloc_flags flags, size_t page_cnt, size_t align,
+           void *caller)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
@@ -78,7 +116,16 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
     return NULL;
 
   lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  if (align <= 1)
+    page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  else
+    page_idx = scan_aligned (pool, page_cnt, align);
+  if (page_idx != BITMAP_ERROR)
+    {
+      enum intr_level old_level = intr_disable ();
+      pool->free_cnt -= page_cnt;
+      intr_set_level (old_level);
+    }
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
@@ -97,33 +144,27 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
         PANIC ("palloc_get: out of pages");
     }
 
+  /* malloc() traces the blocks it carves from its pages instead. */
+  if (!(flags & PAL_NOTRACE))
+    mtrace_alloc (pages, page_cnt * PGSIZE, caller,
+                  flags & PAL_USER ? MTRACE_USER_PAGE : MTRACE_KERNEL_PAGE);
   return pages;
 }
 
-/* Obtains a single free page and returns its kernel virtual
-   address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the page is filled with zeros.  If no pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_page (enum palloc_flags flags) 
-{
-  return palloc_get_multiple (flags, 1);
-}
-
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
+  mtrace_free (pages);
+
   if (page_from_pool (&kernel_pool, pages))
     pool = &kernel_pool;
   else if (page_from_pool (&user_pool, pages))
@@ -137,8 +178,13 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  /* Not under the pool lock: the scheduler frees the pages of
+     dying threads with interrupts off. */
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool->free_cnt += page_cnt;
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,6 +194,46 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages in the user pool if PAL_USER
+   is set in FLAGS, otherwise in the kernel pool.  The count is
+   kept up to date, so this is cheap, but it is only a snapshot
+   unless the caller keeps others from allocating. */
+size_t
+palloc_free_cnt (enum palloc_flags flags)
+{
+  return (flags & PAL_USER ? &user_pool : &kernel_pool)->free_cnt;
+}
+
+/* Returns the first page of the user pool and stores the number
+   of pages in the pool in *PAGE_CNT. */
+void *
+palloc_user_pool (size_t *page_cnt)
+{
+  *page_cnt = bitmap_size (user_pool.used_map);
+  return user_pool.base;
+}
+
+/* Fills in the page pool fields of INFO. */
+void
+palloc_get_meminfo (struct meminfo *info)
+{
+  pool_get_stats (&kernel_pool, &info->kernel_free, &info->kernel_used);
+  pool_get_stats (&user_pool, &info->user_free, &info->user_used);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  struct meminfo info;
+
+  palloc_get_meminfo (&info);
+  printf ("Palloc: kernel pool %zu used, %zu free; "
+          "user pool %zu used, %zu free\n",
+          info.kernel_used, info.kernel_free,
+          info.user_used, info.user_free);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -167,6 +253,38 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   lock_init (&p->lock);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+  p->free_cnt = page_cnt;
+}
+
+/* Finds PAGE_CNT free pages in POOL starting at a physical
+   address that is a multiple of ALIGN pages, marks them used, and
+   returns the index of the first one, or BITMAP_ERROR if there
+   is no such run.  POOL's lock must be held. */
+static size_t
+scan_aligned (struct pool *pool, size_t page_cnt, size_t align)
+{
+  size_t pool_cnt = bitmap_size (pool->used_map);
+  size_t idx = (align - vtop (pool->base) / PGSIZE % align) % align;
+
+  for (; idx + page_cnt <= pool_cnt; idx += align)
+    if (bitmap_none (pool->used_map, idx, page_cnt))
+      {
+        bitmap_set_multiple (pool->used_map, idx, page_cnt, true);
+        return idx;
+      }
+  return BITMAP_ERROR;
+}
+
+/* Stores the number of free and used pages in POOL into
+   *FREE_CNT and *USED_CNT.  The pool lock is not taken, because
+   this is also called while printing statistics on a kernel
+   panic, so the result is only a snapshot. */
+static void
+pool_get_stats (const struct pool *pool, size_t *free_cnt,
+                size_t *used_cnt)
+{
+  *free_cnt = pool->free_cnt;
+  *used_cnt = bitmap_size (pool->used_map) - *free_cnt;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -2,19 +2,26 @@
 #define THREADS_PALLOC_H
 
 #include <stddef.h>
+#include <meminfo.h>
 
 /* How to allocate pages. */
 enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_NOTRACE = 010           /* Not traced: malloc()'s own pages. */
   };
 
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt, size_t align);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+size_t palloc_free_cnt (enum palloc_flags);
+void *palloc_user_pool (size_t *page_cnt);
+void palloc_get_meminfo (struct meminfo *);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
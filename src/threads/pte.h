@@ -66,6 +66,17 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100             /* 1=global, kept in the TLB across CR3 loads. */
+
+/* CR4 bits that make the CPU honor PTE_PS and PTE_G.  See
+   [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x00000010
+#define CR4_PGE 0x00000080
+
+/* CPUID leaf 1 EDX bit for global page support.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+#define CPUID_PGE 0x00002000
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -80,6 +91,23 @@ static inline uint32_t *pde_get_pt (uint32_t pde) {
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps the PTSPAN bytes starting at PAGE,
+   which must be PTSPAN-aligned in physical memory, as a single
+   large page.  The page is readable, writable if WRITABLE is
+   true, and usable by both user and kernel code.  Large PDEs
+   keep their own accessed and dirty bits. */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT (vtop (page) % PTSPAN == 0);
+  return vtop (page) | PTE_PS | PTE_U | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Returns a pointer to the first page of the large page that
+   PDE, which must be present and large, maps. */
+static inline void *pde_get_large (uint32_t pde) {
+  ASSERT ((pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS));
+  return ptov (pde & ~(uint32_t) (PTSPAN - 1));
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
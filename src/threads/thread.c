@@ -131,6 +131,7 @@ thread_tick (void)
   struct thread *t = thread_current ();
 
   /* Update statistics. */
+  t->vtime++;
   if (t == idle_thread)
     idle_ticks++;
 #ifdef USERPROG
@@ -587,13 +588,18 @@ init_thread (struct thread *t, const char *name, int priority)
   t->exit = -1;
 
   list_init(&t->children);
-  list_init(&t->file_descriptors);
+#ifdef USERPROG
+  fdtable_init(&t->fds);
+#endif
   //#ifdef VM
   list_init(&t->mmap_descriptors); // Add Function for project 3
   //#endif
 
   if(t != initial_thread) list_push_back(&(thread_current()->children), &(t->child_elem));
 
+  /* Processes inherit the resident limit of their creator. */
+  if(t != initial_thread) t->rss_limit = thread_current ()->rss_limit;
+
   sema_init(&t->sema_exec, 0);
   sema_init(&t->sema_wait, 0);
   sema_init(&t->sema_wait_2, 0);
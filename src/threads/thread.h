@@ -5,6 +5,7 @@
 #include <list.h>
 #include <stdint.h>
 #include "threads/synch.h"
+#include "userprog/fdtable.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -105,6 +106,7 @@ struct thread
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
+    int64_t vtime;                      /* Timer ticks run: virtual time. */
     //int _priority;                      // Add variable to save original priority
     struct list_elem allelem;           /* List element for all threads list. */
     //int nice;  				// Add nice to implement advanced scheduler
@@ -128,10 +130,13 @@ struct thread
     struct semaphore sema_wait_2;  // thread.h
 
     bool success;
-    struct list file_descriptors;
+    struct fdtable fds;
 
     struct file *openfile;
     struct spage_table *spt;
+    size_t rss_limit;                   /* Resident page limit, 0 for none. */
+    bool suspended;                     /* Load control: stop at next fault. */
+    bool parked;                        /* Blocked there. */
     struct list mmap_descriptors;
 
     /* Owned by thread.c. */
@@ -9,8 +9,8 @@
 #include "threads/vaddr.h"
 #include "vm/page.h"
 #include "vm/frame.h"
-
-#define MAX_STACK_SIZE 0x800000
+#include "vm/loadctl.h"
+#include "vm/vmstat.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -133,6 +133,7 @@ page_fault (struct intr_frame *f)
   bool write;        /* True: access was write, false: access was read. */
   bool user;         /* True: access by user, false: access by kernel. */
   void *fault_addr;  /* Fault address. */
+  uint64_t start;
 
   /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -155,10 +156,18 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+  /* Wait here while load control has the process suspended. */
+  if (user)
+    vm_loadctl_checkpoint ();
+  start = vm_stat_clock ();
+
   bool success = false;
+  enum vmstat_fault type = VMSTAT_FAULT_KILL;
   
   struct thread *cur = thread_current(); 
   void* fault_page = (void*) pg_round_down(fault_addr);
+  /* A kernel access may fault in a call that holds the lock already. */
+  bool locked = vm_spage_table_lock (cur->spt);
 
   if(not_present){
     bool is_correct;
@@ -167,12 +176,33 @@ page_fault (struct intr_frame *f)
     else is_correct = (fault_addr >= cur->esp && PHYS_BASE-MAX_STACK_SIZE <= fault_addr && fault_addr < PHYS_BASE);
     
     if (is_correct) {
-      if (vm_find_spage(cur->spt, fault_page) == NULL)
-	vm_spage_table_install(cur->spt, ZERO, fault_page, NULL, 0, NULL, 0, 0, 0, false);	
+      if (vm_find_spage(cur->spt, fault_page) == NULL){
+	vm_spage_table_install(cur->spt, ZERO, fault_page, NULL, 0, NULL, 0, 0, 0, true);	
+        type = VMSTAT_FAULT_STACK;
+      }
+    }
+
+    struct spage* sp = vm_find_spage(cur->spt, fault_page);
+    if(sp != NULL && type != VMSTAT_FAULT_STACK){
+      if(sp->type == ZERO) type = VMSTAT_FAULT_ZERO;
+      else if(sp->type == SWAP) type = VMSTAT_FAULT_SWAP;
+      else if(sp->type == FILE_SYS) type = VMSTAT_FAULT_FILE;
+      else type = VMSTAT_FAULT_MINOR;
     }
 
-    if(vm_load_page(cur->spt, cur->pagedir, fault_page)) success = true;
+    bool text_hit = false;
+    if(vm_load_page(cur->spt, cur->pagedir, fault_page, write, &text_hit)) success = true;
+    // Another process had the text resident: nothing was read
+    if(text_hit) type = VMSTAT_FAULT_MINOR;
+  }
+  else if(write){
+    success = vm_cow_page(cur->spt, fault_page);
+    type = VMSTAT_FAULT_COW;
   }
+  vm_spage_table_unlock (cur->spt, locked);
+
+  if(!success) type = VMSTAT_FAULT_KILL;
+  vm_stat_fault(cur->spt != NULL ? &cur->spt->faults : NULL, type, start);
 
   if(!success){
     if(!user){
@@ -0,0 +1,163 @@
+#include "userprog/fdtable.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+
+/* File descriptor table.
+
+   Descriptors index directly into an array of open files, so
+   looking one up is a bounds check and an array access.  A
+   bitmap of descriptors in use makes the lowest free descriptor
+   quick to find.  Both grow by doubling when full, so a process
+   pays a few bytes per open file rather than a page.
+
+   Descriptors 0, 1, and 2 are reserved for the console and are
+   never handed out. */
+
+/* Number of reserved descriptors. */
+#define FD_RESERVED 3
+
+/* Initial number of slots. */
+#define FD_INITIAL 16
+
+static bool grow (struct fdtable *);
+
+/* Initializes T as an empty table. */
+void
+fdtable_init (struct fdtable *t)
+{
+  t->files = NULL;
+  t->used = NULL;
+  t->size = 0;
+}
+
+/* Stores FILE in T under the lowest free descriptor and returns
+   the descriptor, or -1 if memory is exhausted. */
+int
+fdtable_insert (struct fdtable *t, struct file *file)
+{
+  size_t fd;
+
+  ASSERT (file != NULL);
+
+  fd = t->used != NULL ? bitmap_scan_and_flip (t->used, 0, 1, false)
+                       : BITMAP_ERROR;
+  if (fd == BITMAP_ERROR)
+    {
+      if (!grow (t))
+        return -1;
+      fd = bitmap_scan_and_flip (t->used, 0, 1, false);
+    }
+
+  t->files[fd] = file;
+  return fd;
+}
+
+/* Returns the file open as FD in T, or a null pointer if FD is
+   not open. */
+struct file *
+fdtable_get (struct fdtable *t, int fd)
+{
+  if (fd < FD_RESERVED || (size_t) fd >= t->size)
+    return NULL;
+  return t->files[fd];
+}
+
+/* Removes FD from T and returns the file it referred to, or a
+   null pointer if FD was not open.  The file is not closed. */
+struct file *
+fdtable_remove (struct fdtable *t, int fd)
+{
+  struct file *file = fdtable_get (t, fd);
+
+  if (file != NULL)
+    {
+      t->files[fd] = NULL;
+      bitmap_reset (t->used, fd);
+    }
+  return file;
+}
+
+/* Makes DST, which must be empty, a copy of SRC in which each
+   descriptor refers to a new opening of the same file at the
+   same position.  Returns true if successful, false if memory
+   is exhausted, in which case DST holds the files copied so
+   far. */
+bool
+fdtable_dup (struct fdtable *dst, struct fdtable *src)
+{
+  size_t fd;
+
+  ASSERT (dst->size == 0);
+
+  while (dst->size < src->size)
+    if (!grow (dst))
+      return false;
+
+  for (fd = FD_RESERVED; fd < src->size; fd++)
+    if (src->files[fd] != NULL)
+      {
+        struct file *file = file_reopen (src->files[fd]);
+        if (file == NULL)
+          return false;
+        file_seek (file, file_tell (src->files[fd]));
+        dst->files[fd] = file;
+        bitmap_mark (dst->used, fd);
+      }
+  return true;
+}
+
+/* Closes every file open in T and frees T's memory, leaving T
+   empty. */
+void
+fdtable_destroy (struct fdtable *t)
+{
+  size_t fd;
+
+  for (fd = FD_RESERVED; fd < t->size; fd++)
+    if (t->files[fd] != NULL)
+      file_close (t->files[fd]);
+
+  free (t->files);
+  if (t->used != NULL)
+    bitmap_destroy (t->used);
+  fdtable_init (t);
+}
+
+/* Doubles the number of slots in T.  Returns true if successful,
+   false if memory is exhausted. */
+static bool
+grow (struct fdtable *t)
+{
+  size_t new_size = t->size == 0 ? FD_INITIAL : t->size * 2;
+  struct file **files;
+  struct bitmap *used;
+  size_t fd;
+
+  used = bitmap_create (new_size);
+  if (used == NULL)
+    return false;
+  files = realloc (t->files, new_size * sizeof *files);
+  if (files == NULL)
+    {
+      bitmap_destroy (used);
+      return false;
+    }
+  memset (files + t->size, 0, (new_size - t->size) * sizeof *files);
+
+  if (t->used != NULL)
+    {
+      for (fd = 0; fd < t->size; fd++)
+        bitmap_set (used, fd, bitmap_test (t->used, fd));
+      bitmap_destroy (t->used);
+    }
+  else
+    bitmap_set_multiple (used, 0, FD_RESERVED, true);
+
+  t->files = files;
+  t->used = used;
+  t->size = new_size;
+  return true;
+}
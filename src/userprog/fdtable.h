@@ -0,0 +1,26 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct bitmap;
+struct file;
+
+/* Per-process table of open files, indexed by file descriptor.
+   A zeroed fdtable is a valid empty table. */
+struct fdtable
+  {
+    struct file **files;        /* Open file per descriptor, or null. */
+    struct bitmap *used;        /* Descriptors in use. */
+    size_t size;                /* Number of slots in FILES and USED. */
+  };
+
+void fdtable_init (struct fdtable *);
+int fdtable_insert (struct fdtable *, struct file *);
+struct file *fdtable_get (struct fdtable *, int fd);
+struct file *fdtable_remove (struct fdtable *, int fd);
+bool fdtable_dup (struct fdtable *dst, struct fdtable *src);
+void fdtable_destroy (struct fdtable *);
+
+#endif /* userprog/fdtable.h */
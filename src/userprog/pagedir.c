@@ -1,13 +1,45 @@
 #include "userprog/pagedir.h"
+#include <list.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/* Page table kept aside while the PTSPAN bytes it mapped are a
+   large page, so that splitting the large page again never needs
+   memory. */
+struct saved_pt
+  {
+    struct list_elem elem;      /* Element in saved_pts. */
+    uint32_t *pde;              /* PDE of the large page. */
+    uint32_t *pt;               /* Its former page table. */
+  };
+
+/* All saved page tables.  Large pages are few, so a list will
+   do.  Accessed with interrupts off, because demotion happens in
+   many contexts. */
+static struct list saved_pts = LIST_INITIALIZER (saved_pts);
+
 static uint32_t *active_pd (void);
+static void load_pagedir (uint32_t *);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static uint32_t *large_pde (uint32_t *pd, const void *vaddr);
+static void demote_pde (uint32_t *pd, uint32_t *pde);
+static struct saved_pt *take_saved_pt (uint32_t *pde);
+
+/* Large page statistics. */
+static long long promote_cnt;   /* # of page tables turned into large pages. */
+static long long demote_cnt;    /* # of large pages split into page tables. */
+
+/* TLB statistics. */
+static long long flush_cnt;     /* # of CR3 loads. */
+static long long invlpg_cnt;    /* # of single-page invalidations. */
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -22,8 +54,9 @@ pagedir_create (void)
   return pd;
 }
 
-/* Destroys page directory PD, freeing all the pages it
-   references. */
+/* Destroys page directory PD and its page tables.  The user
+   pages it maps belong to the frame table, which may share them
+   with other processes, so they are not freed here. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
@@ -34,15 +67,13 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if ((*pde & (PTE_P | PTE_PS)) == PTE_P)
+      palloc_free_page (pde_get_pt (*pde));
+    else if ((*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
       {
-        uint32_t *pt = pde_get_pt (*pde);
-        uint32_t *pte;
-        
-        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
+        struct saved_pt *s = take_saved_pt (pde);
+        palloc_free_page (s->pt);
+        free (s);
       }
   palloc_free_page (pd);
 }
@@ -52,7 +83,9 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR lies in a large page, the large page is first split
+   into a page table of ordinary pages. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -66,6 +99,8 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
+  if ((*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+    demote_pde (pd, pde);
   if (*pde == 0) 
     {
       if (create)
@@ -125,9 +160,13 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 void *
 pagedir_get_page (uint32_t *pd, const void *uaddr) 
 {
-  uint32_t *pte;
+  uint32_t *pte, *pde;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  pde = large_pde (pd, uaddr);
+  if (pde != NULL)
+    return (uint8_t *) pde_get_large (*pde) + ((uintptr_t) uaddr % PTSPAN);
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -152,7 +191,29 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
+    }
+}
+
+/* Makes the mapping of user virtual page UPAGE in PD writable
+   if WRITABLE is true, read-only otherwise.  Has no effect if
+   UPAGE is not mapped. */
+void
+pagedir_set_writable (uint32_t *pd, const void *upage, bool writable)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, false);
+  if (pte != NULL && (*pte & PTE_P) != 0)
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, upage);
     }
 }
 
@@ -163,16 +224,21 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = large_pde (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
-   in PD. */
+   in PD.  If VPAGE lies in a large page, the bit of the whole
+   large page is changed. */
 void
 pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = large_pde (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   if (pte != NULL) 
     {
       if (dirty)
@@ -180,7 +246,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -192,16 +258,21 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = large_pde (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  If VPAGE lies in a large page, the bit of the
+   whole large page is changed. */
 void
 pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = large_pde (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   if (pte != NULL) 
     {
       if (accessed)
@@ -209,18 +280,119 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Returns true if VPAGE lies in a large page of PD. */
+bool
+pagedir_is_large (uint32_t *pd, const void *vpage)
+{
+  return large_pde (pd, vpage) != NULL;
+}
+
+/* Returns true if the PTSPAN bytes of user virtual memory
+   starting at UPAGE, which must be PTSPAN-aligned, are mapped in
+   PD by a page table whose entries are all present and are all
+   writable or all read-only, so that pagedir_promote() may turn
+   them into a large page. */
+bool
+pagedir_can_promote (uint32_t *pd, const void *upage)
+{
+  uint32_t *pde, *pt;
+  size_t i;
+
+  ASSERT ((uintptr_t) upage % PTSPAN == 0);
+
+  if (!is_user_vaddr ((uint8_t *) upage + PTSPAN - 1))
+    return false;
+  pde = pd + pd_no (upage);
+  if ((*pde & PTE_P) == 0 || (*pde & PTE_PS) != 0)
+    return false;
+
+  pt = pde_get_pt (*pde);
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    if ((pt[i] & PTE_P) == 0 || (pt[i] & PTE_W) != (pt[0] & PTE_W))
+      return false;
+  return true;
+}
+
+/* Replaces the page table that maps the PTSPAN bytes starting at
+   user virtual address UPAGE in PD by a single large page at
+   KPAGE, which must already hold a copy of the old pages'
+   contents.  The accessed and dirty bits of the old PTEs are
+   merged into the new PDE.  The old frames are left to the
+   caller.  The page table is kept for demotion.  Returns false,
+   changing nothing, if memory for keeping it runs out. */
+bool
+pagedir_promote (uint32_t *pd, void *upage, void *kpage)
+{
+  struct saved_pt *s;
+  uint32_t *pde, *pt;
+  uint32_t flags = 0;
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT (pagedir_can_promote (pd, upage));
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    return false;
+
+  pde = pd + pd_no (upage);
+  pt = pde_get_pt (*pde);
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    flags |= pt[i] & (PTE_A | PTE_D);
+  s->pde = pde;
+  s->pt = pt;
+  old_level = intr_disable ();
+  list_push_back (&saved_pts, &s->elem);
+  intr_set_level (old_level);
+
+  *pde = pde_create_large (kpage, (pt[0] & PTE_W) != 0) | flags;
+  promote_cnt++;
+  invalidate_pagedir (pd);
+  return true;
+}
+
+/* Fills in the large page fields of INFO. */
+void
+pagedir_get_meminfo (struct meminfo *info)
+{
+  info->large_promotions = promote_cnt;
+  info->large_demotions = demote_cnt;
+}
+
+/* Prints large page statistics. */
+void
+pagedir_print_stats (void)
+{
+  printf ("Pagedir: %lld large page promotions, %lld demotions\n",
+          promote_cnt, demote_cnt);
+  printf ("Pagedir: %lld TLB flushes, %lld single-page invalidations\n",
+          flush_cnt, invlpg_cnt);
+}
+
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already active.  Global kernel mappings
+   stay in the TLB either way. */
 void
 pagedir_activate (uint32_t *pd) 
 {
   if (pd == NULL)
     pd = init_page_dir;
+  if (active_pd () == pd)
+    return;
+  load_pagedir (pd);
+}
+
+/* Loads PD into CR3, which flushes the TLB of all but global
+   mappings. */
+static void
+load_pagedir (uint32_t *pd)
+{
+  flush_cnt++;
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
@@ -243,6 +415,61 @@ active_pd (void)
   return ptov (pd);
 }
 
+/* Returns the PDE in PD for VADDR if it maps a large page,
+   otherwise a null pointer. */
+static uint32_t *
+large_pde (uint32_t *pd, const void *vaddr)
+{
+  uint32_t *pde = pd + pd_no (vaddr);
+  return (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS) ? pde : NULL;
+}
+
+/* Removes the saved page table of the large page mapped by PDE
+   from saved_pts and returns it. */
+static struct saved_pt *
+take_saved_pt (uint32_t *pde)
+{
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  for (e = list_begin (&saved_pts); e != list_end (&saved_pts);
+       e = list_next (e))
+    {
+      struct saved_pt *s = list_entry (e, struct saved_pt, elem);
+      if (s->pde == pde)
+        {
+          list_remove (e);
+          intr_set_level (old_level);
+          return s;
+        }
+    }
+  NOT_REACHED ();
+}
+
+/* Splits the large page mapped by PDE, an entry in PD, into a
+   page table of ordinary pages that map the same frames with the
+   same permissions, reusing the page table saved at promotion.
+   Every new PTE inherits the accessed and dirty bits of the
+   large page. */
+static void
+demote_pde (uint32_t *pd, uint32_t *pde)
+{
+  uint8_t *kpage = pde_get_large (*pde);
+  bool writable = (*pde & PTE_W) != 0;
+  uint32_t flags = *pde & (PTE_A | PTE_D);
+  struct saved_pt *s = take_saved_pt (pde);
+  uint32_t *pt = s->pt;
+  size_t i;
+
+  free (s);
+
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    pt[i] = pte_create_user (kpage + i * PGSIZE, writable) | flags;
+  *pde = pde_create (pt);
+  demote_cnt++;
+  invalidate_pagedir (pd);
+}
+
 /* Seom page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
    table.  When this happens, we have to "invalidate" the TLB by
@@ -256,8 +483,24 @@ invalidate_pagedir (uint32_t *pd)
 {
   if (active_pd () == pd) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
+      /* Re-loading PD clears the TLB.  See [IA32-v3a] 3.12
          "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      load_pagedir (pd);
     } 
 }
+
+/* Invalidates the TLB entry for VADDR, after a change to its PTE
+   in PD, if PD is the active page directory.  Kernel addresses
+   are always invalidated: their page tables are shared by every
+   page directory and their entries are global, so no CR3 load
+   would drop them.  For a large page, any address in it will do.
+   See [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr)
+{
+  if (active_pd () == pd || !is_user_vaddr (vaddr))
+    {
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+      invlpg_cnt++;
+    }
+}
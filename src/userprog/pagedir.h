@@ -3,16 +3,23 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <meminfo.h>
 
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+bool pagedir_is_large (uint32_t *pd, const void *upage);
+bool pagedir_can_promote (uint32_t *pd, const void *upage);
+bool pagedir_promote (uint32_t *pd, void *upage, void *kpage);
 void pagedir_activate (uint32_t *pd);
+void pagedir_get_meminfo (struct meminfo *);
+void pagedir_print_stats (void);
 
 #endif /* userprog/pagedir.h */
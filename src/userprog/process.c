@@ -12,6 +12,7 @@
 #include "vm/frame.h"
 #include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/vmstat.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -26,6 +27,8 @@
 #include "devices/timer.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
+static bool fork_address_space (struct thread *parent, struct thread *child);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
 /* Starts a new thread running a user program loaded from
@@ -64,6 +67,148 @@ process_execute (const char *file_name)
   return tid;
 }
 
+/* What a child created by process_fork() copies from its
+   parent. */
+struct fork_args
+  {
+    struct thread *parent;              /* Forking thread. */
+    struct intr_frame *if_;             /* Its user register state. */
+  };
+
+/* Starts a new process that is a copy of the current one,
+   resuming from the system call whose interrupt frame is IF_.
+   Pages are shared copy-on-write, and open files and memory
+   mappings are reopened at the same positions.  Returns the
+   child's thread id to the parent, or -1 if the copy fails; the
+   child sees 0. */
+tid_t
+process_fork (struct intr_frame *if_)
+{
+  struct fork_args args;
+  struct thread *child;
+  tid_t tid;
+
+  args.parent = thread_current ();
+  args.if_ = if_;
+  tid = thread_create (args.parent->name, PRI_DEFAULT, start_fork, &args);
+  if (tid == TID_ERROR)
+    return -1;
+
+  /* ARGS lives on our stack, so wait until the child is done
+     with it. */
+  child = thread_from_tid (tid);
+  sema_down (&child->sema_exec);
+  if (!child->success)
+    return -1;
+
+  return tid;
+}
+
+/* A thread function that copies the address space of the
+   parent in ARGS_ and returns to user mode as the child. */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_ = *args->if_;
+  bool success = fork_address_space (args->parent, cur);
+
+  if (!success)
+    cur->success = false;
+  sema_up (&cur->sema_exec);
+
+  if (!success)
+    exit (-1);
+
+  /* fork() returns 0 in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+
+  NOT_REACHED ();
+}
+
+/* Gives CHILD, the running thread, a copy of the address space,
+   executable, open files and memory mappings of PARENT.
+   Returns false if memory runs out; whatever was copied is
+   released when CHILD exits. */
+static bool
+fork_address_space (struct thread *parent, struct thread *child)
+{
+  struct list_elem *e;
+  bool success;
+
+  child->pagedir = pagedir_create ();
+  child->spt = vm_spage_table_create ();
+  if (child->pagedir == NULL)
+    return false;
+  process_activate ();
+  child->esp = parent->esp;
+
+  if (parent->openfile != NULL)
+    {
+      child->openfile = file_reopen (parent->openfile);
+      if (child->openfile == NULL)
+        return false;
+      file_deny_write (child->openfile);
+    }
+
+  if (!fdtable_dup (&child->fds, &parent->fds))
+    return false;
+
+  for (e = list_begin (&parent->mmap_descriptors);
+       e != list_end (&parent->mmap_descriptors); e = list_next (e))
+    {
+      struct mmap_descriptor *pm = list_entry (e, struct mmap_descriptor, elem);
+      struct mmap_descriptor *cm = malloc (sizeof *cm);
+
+      if (cm == NULL)
+        return false;
+      *cm = *pm;
+      cm->file = file_reopen (pm->file);
+      if (cm->file == NULL)
+        {
+          free (cm);
+          return false;
+        }
+      list_push_back (&child->mmap_descriptors, &cm->elem);
+    }
+
+  lock_acquire (&child->spt->lock);
+  lock_acquire (&parent->spt->lock);
+  success = vm_spage_table_fork (parent, child);
+  lock_release (&parent->spt->lock);
+  if (!success)
+    {
+      lock_release (&child->spt->lock);
+      return false;
+    }
+
+  /* Pages not loaded yet must read from the child's own files,
+     since the parent's are closed when it exits. */
+  if (child->openfile != NULL)
+    vm_spage_table_replace_file (child->spt, parent->openfile,
+                                 child->openfile);
+  for (e = list_begin (&child->mmap_descriptors);
+       e != list_end (&child->mmap_descriptors); e = list_next (e))
+    {
+      struct mmap_descriptor *cm = list_entry (e, struct mmap_descriptor, elem);
+      struct mmap_descriptor *pm = NULL;
+      struct list_elem *f;
+
+      for (f = list_begin (&parent->mmap_descriptors);
+           f != list_end (&parent->mmap_descriptors); f = list_next (f))
+        {
+          pm = list_entry (f, struct mmap_descriptor, elem);
+          if (pm->id == cm->id)
+            break;
+        }
+      vm_spage_table_replace_file (child->spt, pm->file, cm->file);
+    }
+  lock_release (&child->spt->lock);
+  return true;
+}
+
 int count_arguments(char *str)
 {
   int count = 0;
@@ -205,15 +350,13 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
-  struct list *fdlist = &cur->file_descriptors;
-  while(!list_empty(fdlist)){
-    struct list_elem *e = list_pop_front(fdlist);
-    struct file_descriptor *temp;
-    temp = list_entry(e, struct file_descriptor, elem);
-    
-    file_close(temp->file);
-    palloc_free_page(temp);
-  }
+  /* For the memory report at shutdown. */
+  lock_acquire (&cur->spt->lock);
+  vm_stat_exit (cur->name, cur->tid, vm_spage_table_resident (cur->spt),
+                cur->spt->rss_peak);
+  lock_release (&cur->spt->lock);
+
+  fdtable_destroy(&cur->fds);
   
   struct list *mmlist = &cur->mmap_descriptors;
   while(!list_empty(mmlist)){
@@ -347,6 +490,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
   struct Elf32_Ehdr ehdr;
   struct file *file = NULL;
   off_t file_ofs;
+  uint32_t heap_start = 0;
   bool success = false;
   int i;
 
@@ -432,6 +576,8 @@ load (const char *file_name, void (**eip) (void), void **esp)
               if (!load_segment (file, file_page, (void *) mem_page,
                                  read_bytes, zero_bytes, writable))
                 goto done;
+              if (mem_page + read_bytes + zero_bytes > heap_start)
+                heap_start = mem_page + read_bytes + zero_bytes;
             }
           else
             goto done;
@@ -443,6 +589,9 @@ load (const char *file_name, void (**eip) (void), void **esp)
   if (!setup_stack (esp))
     goto done;
 
+  /* The heap starts out empty, just past the highest segment. */
+  t->spt->heap_start = t->spt->brk = (uint8_t *) heap_start;
+
   /* Start address. */
   *eip = (void (*) (void)) ehdr.e_entry;
   
@@ -458,8 +607,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -526,66 +673,32 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
-  
-  file_seek (file, ofs);
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      vm_spage_table_install(thread_current()->spt, FILE_SYS, upage, NULL, 0, file, ofs, page_read_bytes, page_zero_bytes, writable);
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-      ofs += PGSIZE;
-    }
-  return true;
+
+  struct spage_table *spt = thread_current ()->spt;
+  bool success;
+
+  /* The pages are read in as they are first touched. */
+  lock_acquire (&spt->lock);
+  success = vm_spage_table_map (spt, upage, read_bytes + zero_bytes,
+                                file, ofs, read_bytes, writable, false);
+  lock_release (&spt->lock);
+  return success;
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool
 setup_stack (void **esp) 
-{
-  uint8_t *kpage;
-  bool success = false;
- 
-  kpage = vm_frame_allocate (PHYS_BASE - PGSIZE);  // Modify for Project 3
-  if (kpage != NULL) 
-    {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        vm_frame_deallocate (kpage, true);  // Modify for Project 3
-    }
-  return success;
-}
-
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
-static bool
-install_page (void *upage, void *kpage, bool writable)
 {
   struct thread *t = thread_current ();
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+  bool success;
 
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  if (pagedir_get_page(t->pagedir,upage) == NULL && pagedir_set_page(t->pagedir,upage,kpage,writable)){
-    vm_spage_table_install(t->spt, FRAME, upage, kpage, 0, NULL, 0, 0, 0, false);
-    vm_frame_unpinning(kpage);
-    return true;
-  }
-  return false;
+  lock_acquire (&t->spt->lock);
+  vm_spage_table_install (t->spt, ZERO, upage, NULL, 0, NULL, 0, 0, 0, true);
+  success = vm_load_page (t->spt, t->pagedir, upage, true, NULL);
+  lock_release (&t->spt->lock);
+  if (success)
+    *esp = PHYS_BASE;
+  return success;
 }
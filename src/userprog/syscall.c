@@ -6,25 +6,32 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
+#include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/swap.h"
+#include "vm/vmstat.h"
+#include "vm/zswap.h"
 
 static void syscall_handler (struct intr_frame *);
 
 static int get_user(const uint8_t *uaddr);
 static bool put_user(uint8_t *udst, uint8_t byte);
 int memread(void *src, void *dst, size_t bytes);
-static struct file_descriptor* find_fd(int fd);
+int memwrite(void *src, void *dst, size_t bytes);
+static struct file* find_fd(int fd);
 
 void exit(int status);
 struct lock file_lock;
 
 static struct mmap_descriptor* find_md(int mid);
+static bool setrss(int pid, size_t pages);
 int sys_mmap(int fd, void *upage);
 void sys_munmap(int mid);
 
@@ -129,26 +136,12 @@ syscall_handler (struct intr_frame *f)
     if(!file) exit(-1);
 
     lock_acquire(&file_lock);
-    struct file* openfile;
-    struct file_descriptor* myfd = palloc_get_page(0);
+    struct file* openfile = filesys_open(file);
 
-    if(myfd){
-      openfile = filesys_open(file);
-      if(!openfile){
-        palloc_free_page(myfd);
-	f->eax = -1;
-      }
-      else{
-        myfd->file = openfile;
-       	struct list *fd_list = &thread_current()->file_descriptors;
-        
-        if(list_empty(fd_list)) myfd->id = 3;
-	else myfd->id = (list_entry(list_back(fd_list), struct file_descriptor, elem)->id) + 1;
-        list_push_back(fd_list, &(myfd->elem));
-
-	f->eax = myfd->id;
-      }
-    }    
+    if(openfile){
+      f->eax = fdtable_insert(&thread_current()->fds, openfile);
+      if((int)f->eax == -1) file_close(openfile);
+    }
     else {
       f->eax = -1;
     }
@@ -163,9 +156,9 @@ syscall_handler (struct intr_frame *f)
     memread(f->esp + 4, &fd, sizeof(fd));
     
     lock_acquire(&file_lock);
-    struct file_descriptor* myfd = find_fd(fd);
-    if(myfd && myfd->file){
-      f->eax = file_length(myfd->file);
+    struct file* myfile = find_fd(fd);
+    if(myfile){
+      f->eax = file_length(myfile);
     }
     else {
       f->eax = -1;
@@ -198,9 +191,9 @@ syscall_handler (struct intr_frame *f)
       f->eax = size;
     }
     else{
-      struct file_descriptor* myfd = find_fd(fd);
-      if(myfd && myfd->file){
-	f->eax = file_read(myfd->file, buffer, size);
+      struct file* myfile = find_fd(fd);
+      if(myfile){
+	f->eax = file_read(myfile, buffer, size);
       }
       else {
 	f->eax = -1;
@@ -229,9 +222,9 @@ syscall_handler (struct intr_frame *f)
       f->eax = size;
     }
     else{
-      struct file_descriptor* myfd = find_fd(fd);
-      if(myfd && myfd->file){
-	f->eax = file_write(myfd->file, buffer, size);
+      struct file* myfile = find_fd(fd);
+      if(myfile){
+	f->eax = file_write(myfile, buffer, size);
       }
       else {
 	f->eax = -1;
@@ -250,9 +243,9 @@ syscall_handler (struct intr_frame *f)
     memread(f->esp+8, &position, sizeof(position));
     
     lock_acquire(&file_lock);
-    struct file_descriptor* myfd = find_fd(fd);
-    if(myfd && myfd->file){
-      file_seek(myfd->file, position);
+    struct file* myfile = find_fd(fd);
+    if(myfile){
+      file_seek(myfile, position);
     }
     lock_release(&file_lock);
     
@@ -265,9 +258,9 @@ syscall_handler (struct intr_frame *f)
     memread(f->esp+4, &fd, sizeof(fd));
 	   
     lock_acquire(&file_lock);
-    struct file_descriptor* myfd = find_fd(fd);
-    if(myfd && myfd->file){
-      f->eax = file_tell(myfd->file);
+    struct file* myfile = find_fd(fd);
+    if(myfile){
+      f->eax = file_tell(myfile);
     }
     else {
       f->eax = -1;
@@ -283,11 +276,9 @@ syscall_handler (struct intr_frame *f)
     memread(f->esp+4, &fd, sizeof(fd));
     
     lock_acquire(&file_lock);
-    struct file_descriptor* myfd = find_fd(fd);
-    if(myfd && myfd->file){
-      list_remove(&(myfd->elem));
-      file_close(myfd->file);
-      palloc_free_page(myfd);
+    struct file* myfile = fdtable_remove(&thread_current()->fds, fd);
+    if(myfile){
+      file_close(myfile);
     }
     lock_release(&file_lock);
     
@@ -314,6 +305,111 @@ syscall_handler (struct intr_frame *f)
     
     break;
   }
+  case SYS_MSYNC:
+  {
+    int mid;
+
+    memread(f->esp + 4, &mid, sizeof(mid));
+
+    f->eax = msync(mid);
+
+    break;
+  }
+  case SYS_MADVISE:
+  {
+    struct thread* cur = thread_current();
+    void* addr;
+    size_t len;
+    int advice;
+
+    memread(f->esp + 4, &addr, sizeof(addr));
+    memread(f->esp + 8, &len, sizeof(len));
+    memread(f->esp + 12, &advice, sizeof(advice));
+
+    lock_acquire(&file_lock);
+    lock_acquire(&cur->spt->lock);
+    f->eax = vm_spage_table_advise(cur->spt, cur->pagedir, addr, len, advice);
+    lock_release(&cur->spt->lock);
+    lock_release(&file_lock);
+
+    break;
+  }
+  case SYS_FORK:
+  {
+    lock_acquire(&file_lock);
+    f->eax = process_fork(f);
+    lock_release(&file_lock);
+
+    break;
+  }
+  case SYS_MEMINFO:
+  {
+    struct thread* cur = thread_current();
+    struct meminfo* uinfo;
+    struct meminfo info;
+
+    memread(f->esp + 4, &uinfo, sizeof(uinfo));
+
+    palloc_get_meminfo(&info);
+    malloc_get_meminfo(&info);
+    vm_frame_get_meminfo(&info);
+    vm_swap_get_meminfo(&info);
+    vm_zswap_get_meminfo(&info);
+    pagedir_get_meminfo(&info);
+    lock_acquire(&cur->spt->lock);
+    info.resident_pages = vm_spage_table_resident(cur->spt);
+    lock_release(&cur->spt->lock);
+
+    memwrite(&info, uinfo, sizeof(info));
+    f->eax = true;
+
+    break;
+  }
+  case SYS_VMSTAT:
+  {
+    struct thread* cur = thread_current();
+    struct vmstat* uinfo;
+    struct vmstat info;
+
+    memread(f->esp + 4, &uinfo, sizeof(uinfo));
+
+    vm_stat_get(&cur->spt->faults, &info);
+    info.rss = cur->spt->rss;
+    info.rss_limit = cur->rss_limit;
+    info.rss_evict = cur->spt->rss_evict_cnt;
+
+    memwrite(&info, uinfo, sizeof(info));
+    f->eax = true;
+
+    break;
+  }
+  case SYS_SBRK:
+  {
+    struct thread* cur = thread_current();
+    intptr_t increment;
+    void* old;
+
+    memread(f->esp + 4, &increment, sizeof(increment));
+
+    lock_acquire(&cur->spt->lock);
+    old = vm_spage_table_sbrk(cur->spt, cur->pagedir, increment);
+    lock_release(&cur->spt->lock);
+    f->eax = old != NULL ? (uint32_t)old : (uint32_t)-1;
+
+    break;
+  }
+  case SYS_SETRSS:
+  {
+    int pid;
+    size_t pages;
+
+    memread(f->esp + 4, &pid, sizeof(pid));
+    memread(f->esp + 8, &pages, sizeof(pages));
+
+    f->eax = setrss(pid, pages);
+
+    break;
+  }
   default:
     exit(-1);
 
@@ -353,20 +449,18 @@ int memread (void* src, void* dst, size_t bytes){
   return (int)bytes;
 }
 
-struct file_descriptor* find_fd(int fd){
-  struct thread *cur = thread_current();
-  struct list_elem *e;
-  
-  if(fd < 3) return NULL;
-
-  if(list_empty(&cur->file_descriptors)) return NULL;
+int memwrite (void* src, void* dst, size_t bytes){
+  size_t i;
 
-  for(e = list_begin(&cur->file_descriptors); e != list_end(&cur->file_descriptors); e = list_next(e)){
-    struct file_descriptor *temp = list_entry(e, struct file_descriptor, elem);
-    if (temp->id == fd) return temp;
+  for(i = 0; i < bytes; i++){
+    if(!put_user(dst+i, *(char*)(src+i))) exit(-1);
   }
-  
-  return NULL;
+
+  return (int)bytes;
+}
+
+static struct file* find_fd(int fd){
+  return fdtable_get(&thread_current()->fds, fd);
 }
 
 static struct mmap_descriptor * find_md (int mid) {
@@ -382,6 +476,29 @@ static struct mmap_descriptor * find_md (int mid) {
   return NULL;
 }
 
+// Sets the resident limit of process PID, or of the caller if PID is 0,
+// to PAGES, 0 for none.  A process may set any limit on its children,
+// but only lower its own: it cannot raise or lift a limit it was given.
+// The limit takes effect as the process faults in more pages.
+static bool setrss(int pid, size_t pages){
+  struct thread* cur = thread_current();
+  struct list_elem* e;
+
+  if(pid == 0 || pid == cur->tid){
+    if(pages == 0 || (cur->rss_limit != 0 && pages > cur->rss_limit)) return false;
+    cur->rss_limit = pages;
+    return true;
+  }
+  for(e = list_begin(&cur->children); e != list_end(&cur->children); e = list_next(e)){
+    struct thread* child = list_entry(e, struct thread, child_elem);
+    if(child->tid == pid){
+      child->rss_limit = pages;
+      return true;
+    }
+  }
+  return false;
+}
+
 void exit(int status){
   struct thread* cur = thread_current();
   cur->exit = status;
@@ -399,9 +516,9 @@ int mmap(int fd, void *upage) {
   lock_acquire(&file_lock);
 
   struct file *f = NULL;
-  struct file_descriptor* f_descriptor = find_fd(fd);
-  if(f_descriptor && f_descriptor->file) {
-    f = file_reopen (f_descriptor->file);
+  struct file* fd_file = find_fd(fd);
+  if(fd_file) {
+    f = file_reopen (fd_file);
   }
 
   if(f==NULL)
@@ -417,23 +534,16 @@ int mmap(int fd, void *upage) {
     return -1;
   }
   
-  if(vm_find_spage(cur->spt, upage)!=NULL || vm_find_spage(cur->spt, upage + file_size*PGSIZE)!=NULL){
+  // Keep clear of the area the stack may grow into
+  lock_acquire(&cur->spt->lock);
+  if((uint8_t*)upage + file_size > (uint8_t*)PHYS_BASE - MAX_STACK_SIZE
+     || !vm_spage_table_map(cur->spt, upage, file_size, f, 0, file_size, true, true)){
+    lock_release(&cur->spt->lock);
+    file_close(f);
     lock_release(&file_lock);
     return -1;
   }
-
-  size_t i;
-  for(i = 0; i < file_size; i += PGSIZE) {
-    void *addr = upage + i;
-
-    size_t read_bytes;
-    if(i + PGSIZE < file_size)
-      read_bytes = PGSIZE;
-    else
-      read_bytes = file_size - i;
-
-    vm_spage_table_install(cur->spt, FILE_SYS, upage + i, NULL, 0, f, i, read_bytes, PGSIZE - read_bytes, true);
-  }
+  lock_release(&cur->spt->lock);
 
   int mid = 1;
   if(!list_empty(&cur->mmap_descriptors))
@@ -450,6 +560,32 @@ int mmap(int fd, void *upage) {
   return mid;
 }
 
+bool msync(int mid)
+{
+  struct thread *cur = thread_current();
+  struct mmap_descriptor *m_descriptor = find_md(mid);
+
+  if(m_descriptor == NULL)
+    return false;
+
+  lock_acquire (&file_lock);
+  lock_acquire (&cur->spt->lock);
+  size_t file_size = m_descriptor->size;
+  void* addr = m_descriptor->addr;
+  size_t i;
+  for(i = 0; i < file_size; i += PGSIZE) {
+    size_t bytes;
+    if (i + PGSIZE < file_size) bytes = PGSIZE;
+    else bytes = file_size - i;
+
+    vm_spage_table_mm_sync (cur->spt, cur->pagedir, addr + i, m_descriptor->file, i, bytes);
+  }
+  lock_release(&cur->spt->lock);
+  lock_release(&file_lock);
+
+  return true;
+}
+
 void munmap(int mid)
 {
   struct thread *cur = thread_current();
@@ -459,6 +595,7 @@ void munmap(int mid)
     return false;
 
   lock_acquire (&file_lock);
+  lock_acquire (&cur->spt->lock);
   size_t file_size = m_descriptor->size;
   void* addr = m_descriptor->addr;
   size_t i;
@@ -469,6 +606,8 @@ void munmap(int mid)
 
     vm_spage_table_mm_unmap (cur->spt, cur->pagedir, addr + i, m_descriptor->file, i, bytes);
   }
+  vm_spage_table_unmap (cur->spt, addr);
+  lock_release(&cur->spt->lock);
 
   list_remove(&m_descriptor->elem);
   file_close(m_descriptor->file);
@@ -1,8 +1,15 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include "threads/synch.h"
+
 void syscall_init (void);
 void exit(int status);
 void munmap(int mid);
+bool msync(int mid);
+
+/* Serializes file system access. */
+extern struct lock file_lock;
 
 #endif /* userprog/syscall.h */
@@ -1,76 +1,568 @@
 #include "vm/frame.h"
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "devices/timer.h"
+#include "threads/pte.h"
+#include "userprog/syscall.h"
+#include "vm/loadctl.h"
+#include "vm/swap.h"
+#include "vm/vmstat.h"
 
 static struct lock frame_lock;
-static struct hash frame_hash;
-static struct list frame_list;
 
-struct list_elem* before;
+// Frame table, indexed by page number within the user pool
+static struct frame* frames;
+static uint8_t* user_base;   // First page of the user pool
+static size_t frame_slots;   // Pages in the user pool
+static size_t frame_cnt;     // Entries in use
 
-struct frame* next_candi(void){
-  if(before == NULL) before = list_begin(&frame_list);
-  else if(before == list_end(&frame_list)) before = list_begin(&frame_list);
-  else before = list_next(before);
+// Text cache: frames holding read-only executable pages, by
+// (inode, offset), so that every process running a program maps
+// the same frames for its code
+static struct hash text_hash;
+static unsigned long long text_hit_cnt;
 
-  return list_entry(before, struct frame, elem_);
+// Number of pinned frames, for statistics
+static size_t pinned_cnt;
+
+// Evictions write to swap without frame_lock.  Threads that need a page
+// in transit wait on the condition its frame index hashes to; threads
+// that need a free frame while every candidate is in transit wait on
+// frame_freed.
+#define TRANSIT_WAIT_CNT 16
+static struct condition transit_wait[TRANSIT_WAIT_CNT];
+static struct condition frame_freed;
+static size_t transit_cnt;                   // Frames in transit now
+static unsigned long long transit_wait_cnt;  // Waits for pages in transit
+static unsigned long long file_discard_cnt;  // Clean file pages evicted without swap
+static unsigned long long swap_cache_hit_cnt;  // Evictions reusing the slot of a swapped-in page
+
+// Flusher: every FLUSH_INTERVAL ticks, writes dirty mmap frames back to
+// their files, FLUSH_BATCH frames per hold of file_lock
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+#define FLUSH_BATCH 16
+static unsigned long long flush_cnt;
+
+// Free user frame watermarks of the reclaim daemon (-wm=LOW,HIGH)
+size_t vm_frame_low_wm;
+size_t vm_frame_high_wm;
+
+static struct semaphore reclaim_sema;  // Wakes the reclaim daemon
+static bool reclaim_pending;           // Daemon woken and not done yet
+static bool reclaim_started;
+
+// Clock hand: index of the last frame looked at
+static size_t clock_hand;
+
+// Page replacement by WSClock instead of the clock (-evict=wsclock), with
+// a working-set window in ticks of process virtual time (-ws=TICKS)
+bool vm_frame_wsclock;
+int64_t vm_frame_ws_window = TIMER_FREQ;
+
+// Working-set scanner: every WS_SCAN_INTERVAL ticks, folds accessed bits
+// into last-use times, WS_SCAN_BATCH frames per hold of frame_lock
+#define WS_SCAN_INTERVAL (TIMER_FREQ / 4)
+#define WS_SCAN_BATCH 64
+static unsigned long long ws_scan_cnt;
+
+// Frames looked at by one pass of the clock
+#define CLOCK_SCAN_MAX 1024
+
+static void* frame_kpage(struct frame* f){
+  return user_base + (size_t)(f - frames) * PGSIZE;
+}
+
+// Returns the entry of KPAGE if it is a frame in use, otherwise NULL.
+static struct frame* find_frame(void* kpage){
+  size_t idx = ((uint8_t*)kpage - user_base) / PGSIZE;
+
+  if((uint8_t*)kpage < user_base || idx >= frame_slots || !frames[idx].used) return NULL;
+  return &frames[idx];
+}
+
+// Advances *HAND to the next frame in use whose first user is OWNER, or
+// to the next frame in use if OWNER is NULL.  There must be one.
+static struct frame* next_candi(size_t* hand, struct thread* owner){
+  do{
+    if(++*hand >= frame_slots) *hand = 0;
+  } while(!frames[*hand].used || (owner != NULL && frames[*hand].t != owner));
+
+  return &frames[*hand];
 }
 
-void evict_frame(uint32_t* pagedir) {
-  struct frame* f = next_candi();
-  while(1){
-    if(pagedir_is_accessed(pagedir, f->upage)) pagedir_set_accessed(pagedir, f->upage, false);
-    else if(!(f->pinned)) break;
-    f = next_candi();
+// Waits for F, which is in transit, to be written out. frame_lock must be
+// held.  Wakeups may be for other frames: callers check again.
+static void wait_transit(struct frame* f){
+  transit_wait_cnt++;
+  cond_wait(&transit_wait[(f - frames) % TRANSIT_WAIT_CNT], &frame_lock);
+}
+
+// Returns true if F's page was written since it was loaded.
+// Only the first user can have written it: sharers map it read-only.
+static bool frame_is_dirty(struct frame* f){
+  return pagedir_is_dirty(f->t->pagedir, f->upage) || pagedir_is_dirty(f->t->pagedir, frame_kpage(f));
+}
+
+// Returns true if any process mapping F accessed it since the last
+// call, and clears the accessed bits.
+// The frames of a large page, never shared, have one accessed bit
+// between them.  It is cleared only at the last of them, which a clock
+// hand sweeping the frames in order reaches last, so that the whole
+// large page is kept or found unreferenced together.
+static bool frame_test_accessed(struct frame* f){
+  bool accessed = false;
+  struct frame_map* m;
+
+  if(pagedir_is_large(f->t->pagedir, f->upage)){
+    accessed = pagedir_is_accessed(f->t->pagedir, f->upage);
+    if(accessed && pg_no(f->upage) % (PTSPAN / PGSIZE) == PTSPAN / PGSIZE - 1)
+      pagedir_set_accessed(f->t->pagedir, f->upage, false);
+    return accessed;
+  }
+
+  if(pagedir_is_accessed(f->t->pagedir, f->upage)){
+    pagedir_set_accessed(f->t->pagedir, f->upage, false);
+    accessed = true;
+  }
+  for(m = f->maps; m != NULL; m = m->next){
+    if(pagedir_is_accessed(m->t->pagedir, m->upage)){
+      pagedir_set_accessed(m->t->pagedir, m->upage, false);
+      accessed = true;
+    }
   }
+  return accessed;
+}
+
+// Picks an eviction victim with a two-pass clock. frame_lock must be held.
+// Accessed bits are tested and cleared in the page directory of every
+// process mapping the frame.  The first pass takes the first clean, unreferenced frame;
+// failing that, the first dirty, unreferenced one it passed.  If every
+// frame was referenced, the second pass sees the bits the first cleared.
+// Each pass looks at no more than CLOCK_SCAN_MAX frames, after which the
+// first unpinned frame seen is taken regardless of its bits.
+// Frames of MADV_SEQUENTIAL ranges get no second chance: once a scan
+// has gone past them, they are not needed again.
+// If OWNER is not NULL, only the frames OWNER is the first user of are
+// looked at, with OWNER's own clock hand.
+// Returns NULL if all frames looked at are pinned.  Adds the number of
+// frames looked at to *SCANNED.
+static struct frame* clock_select(struct thread* owner, size_t* scanned){
+  size_t* hand = owner != NULL ? &owner->spt->rss_hand : &clock_hand;
+  size_t scan = owner != NULL ? owner->spt->rss : frame_cnt;
+  struct frame* dirty = NULL;
+  struct frame* any = NULL;
+  int pass;
+  size_t i;
+
+  if(scan == 0) return NULL;
+  if(scan > CLOCK_SCAN_MAX) scan = CLOCK_SCAN_MAX;
+
+  for(pass = 0; pass < 2; pass++){
+    for(i = 0; i < scan; i++){
+      struct frame* f = next_candi(hand, owner);
+
+      (*scanned)++;
+      if(f->pinned || f->transit) continue;
+      if(any == NULL) any = f;
+      if(frame_test_accessed(f) && !f->sequential) continue;
+      if(!frame_is_dirty(f)) return f;
+      if(dirty == NULL) dirty = f;
+    }
+    if(dirty != NULL) return dirty;
+  }
+  return any;
+}
+
+// Picks an eviction victim with WSClock. frame_lock must be held.
+// Accessed bits are folded into last-use times as the hand passes, as
+// the working-set scanner does.  A frame is out of the working set once
+// its first user has run for more than vm_frame_ws_window ticks since
+// the frame was last seen accessed; MADV_SEQUENTIAL frames always are.
+// The first clean frame out of the working set is taken; failing that,
+// the first dirty one, then the least recently used frame looked at,
+// then the first unpinned one.  Looks at no more than CLOCK_SCAN_MAX
+// frames, and at OWNER's frames only if OWNER is not NULL.
+// Returns NULL if all frames looked at are pinned.  Adds the number of
+// frames looked at to *SCANNED.
+static struct frame* wsclock_select(struct thread* owner, size_t* scanned){
+  size_t* hand = owner != NULL ? &owner->spt->rss_hand : &clock_hand;
+  size_t scan = owner != NULL ? owner->spt->rss : frame_cnt;
+  struct frame* dirty = NULL;
+  struct frame* oldest = NULL;
+  struct frame* any = NULL;
+  int64_t oldest_age = 0;
+  size_t i;
+
+  if(scan > CLOCK_SCAN_MAX) scan = CLOCK_SCAN_MAX;
+
+  for(i = 0; i < scan; i++){
+    struct frame* f = next_candi(hand, owner);
+    int64_t age;
+
+    (*scanned)++;
+    if(f->pinned || f->transit) continue;
+    if(any == NULL) any = f;
+    if(frame_test_accessed(f)){
+      f->last_use = f->t->vtime;
+      if(!f->sequential) continue;
+    }
+
+    age = f->t->vtime - f->last_use;
+    if(f->sequential || age > vm_frame_ws_window){
+      if(!frame_is_dirty(f)) return f;
+      if(dirty == NULL) dirty = f;
+    }
+    else if(oldest == NULL || age > oldest_age){
+      oldest = f;
+      oldest_age = age;
+    }
+  }
+  if(dirty != NULL) return dirty;
+  return oldest != NULL ? oldest : any;
+}
+
+// Returns true if frame F still holds what the file of every page
+// mapping it has, so that it can be read again instead of going to
+// swap.  DIRTY is F's dirty bit.
+static bool frame_is_clean_file(struct frame* f, bool dirty){
+  struct frame_map* m;
+
+  if(dirty || f->sp->file == NULL || f->sp->dirty) return false;
+  for(m = f->maps; m != NULL; m = m->next)
+    if(m->sp->file == NULL || m->sp->dirty) return false;
+  return true;
+}
+
+// Turns SP, T's page, back into a FILE_SYS page to be read from its
+// file again, evicted with sequence number SEQ.  The entry is deleted
+// instead if its region can make it again.
+static void revert_file(struct thread* t, struct spage* sp, uint32_t seq){
+  vm_spage_drop_swap_slot(sp);
+  sp->type = FILE_SYS;
+  sp->kpage = NULL;
+  sp->evicted_at = seq;
+  vm_spage_table_forget(t->spt, sp);
+}
+
+// Makes SP a SWAP page held by swap SLOT.
+static void swap_page(struct spage* sp, size_t slot){
+  sp->type = SWAP;
+  sp->kpage = NULL;
+  sp->sector_index = slot;
+  sp->swap_cached = false;
+}
+
+// Hands the evicted frame F over to swap SLOT: every page mapping F
+// becomes SWAP with a reference to SLOT, and the frame is freed.
+// frame_lock must be held.
+static void swap_frame(struct frame* f, size_t slot, uint32_t seq, bool dirty){
+  struct frame_map* m;
+
+  swap_page(f->sp, slot);
+  f->sp->evicted_at = seq;
+  if(dirty) f->sp->dirty = true;
+  for(m = f->maps; m != NULL; m = m->next){
+    // Cannot fail: a frame has fewer mappings than a slot can count
+    vm_swap_dup(slot);
+    swap_page(m->sp, slot);
+  }
+  vm_frame_deallocate(frame_kpage(f), true);
+}
+
+// Evicts one frame chosen by clock_select(). frame_lock must be held;
+// it is released while the frame is written to swap.  Meanwhile the
+// frame is in transit: unmapped everywhere but still owned by its pages,
+// so that faults on them wait for the write instead of reading the slot.
+// A shared frame is written to swap once, and every process mapping it
+// gets a reference to the same swap slot.  Text frames are never
+// written: their pages are simply read from the executable again.  The
+// same goes for clean pages of other files, and a page still clean
+// since it was read back from swap goes back to the slot it kept.
+// With OWNER, evicts one of OWNER's own frames, to keep it within its
+// resident limit.
+// Returns false if no frame could be evicted because all are pinned or
+// in transit.
+static bool evict_frame(struct thread* owner) {
+  size_t scanned = 0;
+  struct frame* f = vm_frame_wsclock ? wsclock_select(owner, &scanned) : clock_select(owner, &scanned);
+  struct frame_map* m;
+  struct spage* sp;
+  void* kpage;
+  uint32_t seq;
+  bool dirty;
+  size_t slot;
+
+  if(f == NULL) return false;
+
+  dirty = frame_is_dirty(f);
   pagedir_clear_page(f->t->pagedir, f->upage);
-  vm_spage_table_install(f->t->spt, SWAP, f->upage, NULL, vm_swap_out(f->kpage), NULL, 0, 0, 0, false);
-  
-  if(pagedir_is_dirty(f->t->pagedir, f->upage)||pagedir_is_dirty(f->t->pagedir, f->kpage))
-    vm_find_spage(f->t->spt, f->upage)->dirty = true;
+  for(m = f->maps; m != NULL; m = m->next)
+    pagedir_clear_page(m->t->pagedir, m->upage);
+
+  seq = vm_loadctl_evicted();
+  if(f->text){
+    revert_file(f->t, f->sp, seq);
+    for(m = f->maps; m != NULL; m = m->next)
+      revert_file(m->t, m->sp, seq);
+    vm_stat_evict(VMSTAT_EVICT_TEXT, false, scanned, owner != NULL);
+    if(owner != NULL) owner->spt->rss_evict_cnt++;
+    vm_frame_deallocate(frame_kpage(f), true);
+    return true;
+  }
+
+  sp = f->sp;
+  vm_stat_evict(sp->file != NULL ? VMSTAT_EVICT_FILE : VMSTAT_EVICT_ANON, dirty, scanned, owner != NULL);
+  if(owner != NULL) owner->spt->rss_evict_cnt++;
+
+  // Clean file pages are dropped: swap is kept for what needs writing
+  if(frame_is_clean_file(f, dirty)){
+    file_discard_cnt++;
+    revert_file(f->t, sp, seq);
+    for(m = f->maps; m != NULL; m = m->next)
+      revert_file(m->t, m->sp, seq);
+    vm_frame_deallocate(frame_kpage(f), true);
+    cond_broadcast(&frame_freed, &frame_lock);
+    return true;
+  }
+
+  // A page left clean since it was swapped in is still in its slot
+  if(sp->swap_cached && !dirty){
+    swap_cache_hit_cnt++;
+    swap_frame(f, sp->sector_index, seq, false);
+    cond_broadcast(&frame_freed, &frame_lock);
+    return true;
+  }
+  vm_spage_drop_swap_slot(sp);
 
-  vm_frame_deallocate(f->kpage, true);
+  // The mappings of a frame in transit do not change: the calls that
+  // would change them wait for it or back off
+  kpage = frame_kpage(f);
+  f->transit = true;
+  transit_cnt++;
+  lock_release(&frame_lock);
+
+  slot = vm_swap_out(kpage);
+
+  lock_acquire(&frame_lock);
+  f->transit = false;
+  transit_cnt--;
+  swap_frame(f, slot, seq, dirty);
+  cond_broadcast(&transit_wait[(f - frames) % TRANSIT_WAIT_CNT], &frame_lock);
+  cond_broadcast(&frame_freed, &frame_lock);
+  return true;
+}
+
+// Reclaim daemon: whenever free user frames drop below the low
+// watermark, evicts frames until the high watermark is reached, so
+// that faulting threads find a free frame without evicting themselves.
+static void reclaim_daemon(void* aux UNUSED){
+  for(;;){
+    sema_down(&reclaim_sema);
+
+    lock_acquire(&frame_lock);
+    while(palloc_free_cnt(PAL_USER) < vm_frame_high_wm && evict_frame(NULL)){
+      // Let faulting threads in between evictions: releasing the lock
+      // only wakes them, it does not yield
+      lock_release(&frame_lock);
+      thread_yield();
+      lock_acquire(&frame_lock);
+    }
+    reclaim_pending = false;
+    lock_release(&frame_lock);
+  }
+}
+
+// Working-set scanner, for WSClock: keeps last-use times current for
+// frames the eviction hand does not reach for a while.
+static void ws_scan_daemon(void* aux UNUSED){
+  size_t idx, end;
+
+  for(;;){
+    timer_sleep(WS_SCAN_INTERVAL);
+
+    for(idx = 0; idx < frame_slots; ){
+      lock_acquire(&frame_lock);
+      for(end = idx + WS_SCAN_BATCH; idx < frame_slots && idx < end; idx++){
+        struct frame* f = &frames[idx];
+        if(f->used && !f->transit && frame_test_accessed(f)) f->last_use = f->t->vtime;
+      }
+      lock_release(&frame_lock);
+    }
+    ws_scan_cnt++;
+  }
+}
+
+// Starts the reclaim daemon, and the working-set scanner in WSClock
+// mode. Must be called after the swap device is set up.
+// Without -wm, the watermarks default to 1/32 and 1/16 of the user pool.
+void vm_frame_reclaim_init(void){
+  size_t user_pages = palloc_free_cnt(PAL_USER);
+
+  if(vm_frame_high_wm == 0){
+    vm_frame_low_wm = user_pages / 32 + 1;
+    vm_frame_high_wm = 2 * vm_frame_low_wm;
+  }
+  if(vm_frame_high_wm < vm_frame_low_wm) vm_frame_high_wm = vm_frame_low_wm;
+
+  sema_init(&reclaim_sema, 0);
+  if(thread_create("reclaimd", PRI_DEFAULT, reclaim_daemon, NULL) != TID_ERROR)
+    reclaim_started = true;
+  if(vm_frame_wsclock) thread_create("wsscand", PRI_DEFAULT, ws_scan_daemon, NULL);
+}
+
+// Writes back up to FLUSH_BATCH dirty frames of mmap regions and returns
+// how many.  Each is marked clean and pinned before file_lock is used
+// to write it; stores made meanwhile dirty it again.
+static size_t flush_batch(void){
+  struct {
+    void* kpage;
+    struct file* file;
+    off_t offset;
+    size_t bytes;
+  } batch[FLUSH_BATCH];
+  size_t n = 0, i, idx;
+
+  // file_lock keeps munmap() and exit from closing the files.  Pages are
+  // reached through their frames, without the owners' page tables.
+  lock_acquire(&file_lock);
+  lock_acquire(&frame_lock);
+  for(idx = 0; idx < frame_slots && n < FLUSH_BATCH; idx++){
+    struct frame* f = &frames[idx];
+    void* kpage = frame_kpage(f);
+    uint32_t* pd;
+    struct spage* sp;
+
+    // Copy-on-write sharers of a mapping write their own copies
+    if(!f->used || f->pinned || f->transit || f->refcnt != 1 || (pd = f->t->pagedir) == NULL) continue;
+    sp = f->sp;
+    if(!sp->mmap || sp->kpage != kpage) continue;
+    if(!sp->dirty && !pagedir_is_dirty(pd, f->upage) && !pagedir_is_dirty(pd, kpage)) continue;
+
+    vm_spage_drop_swap_slot(sp);
+    sp->dirty = false;
+    pagedir_set_dirty(pd, f->upage, false);
+    pagedir_set_dirty(pd, kpage, false);
+    f->pinned = true;
+    pinned_cnt++;
+
+    batch[n].kpage = kpage;
+    batch[n].file = sp->file;
+    batch[n].offset = sp->offset;
+    batch[n].bytes = sp->read_bytes;
+    n++;
+  }
+  lock_release(&frame_lock);
+
+  for(i = 0; i < n; i++){
+    file_write_at(batch[i].file, batch[i].kpage, batch[i].bytes, batch[i].offset);
+    vm_frame_unpinning(batch[i].kpage);
+  }
+  flush_cnt += n;
+  lock_release(&file_lock);
+
+  return n;
+}
+
+// Flusher: keeps mmap regions mostly clean, so that munmap(), exit and
+// eviction find few pages left to write.
+static void flush_daemon(void* aux UNUSED){
+  for(;;){
+    timer_sleep(FLUSH_INTERVAL);
+    while(flush_batch() == FLUSH_BATCH) continue;
+  }
+}
+
+// Starts the flusher. Must be called after syscall_init().
+void vm_frame_flush_init(void){
+  thread_create("flushd", PRI_DEFAULT, flush_daemon, NULL);
 }
 
-static unsigned hash_func(const struct hash_elem* elem, void* aux) {
-  struct frame *a = hash_entry(elem, struct frame, elem);
-  return hash_bytes(&a->kpage, sizeof a->kpage); 
+static unsigned text_hash_func(const struct hash_elem* elem, void* aux UNUSED) {
+  struct frame *f = hash_entry(elem, struct frame, text_elem);
+  return hash_int(f->text_inumber) ^ hash_int(f->text_offset);
 }
 
-static bool less_func(const struct hash_elem* a, const struct hash_elem* b, void* aux) {
-  struct frame *a_ = hash_entry(a, struct frame, elem);
-  struct frame *b_ = hash_entry(b, struct frame, elem);
-  return a_->kpage < b_->kpage;
+static bool text_less_func(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  struct frame *a_ = hash_entry(a, struct frame, text_elem);
+  struct frame *b_ = hash_entry(b, struct frame, text_elem);
+  if(a_->text_inumber != b_->text_inumber) return a_->text_inumber < b_->text_inumber;
+  return a_->text_offset < b_->text_offset;
 }
 
 void vm_frame_init() {
+  size_t i;
+
   lock_init(&frame_lock);
-  hash_init(&frame_hash, hash_func, less_func, NULL);
-  list_init(&frame_list);
-  before = NULL;
+  for(i = 0; i < TRANSIT_WAIT_CNT; i++) cond_init(&transit_wait[i]);
+  cond_init(&frame_freed);
+  hash_init(&text_hash, text_hash_func, text_less_func, NULL);
+
+  user_base = palloc_user_pool(&frame_slots);
+  frames = palloc_get_multiple(PAL_ASSERT | PAL_ZERO, DIV_ROUND_UP(frame_slots * sizeof *frames, PGSIZE));
+  frame_cnt = 0;
+  clock_hand = 0;
+}
+
+// Adds DELTA frames, at UPAGE, to T's resident set.
+static void charge(struct thread* t, void* upage, int delta){
+  t->spt->rss += delta;
+  if(t->spt->rss > t->spt->rss_peak) t->spt->rss_peak = t->spt->rss;
+  t->spt->pt_rss[pd_no(upage)] += delta;
 }
 
-void* vm_frame_allocate(void* upage) {
+// Returns a pinned frame for SP, a page of the current process,
+// evicting if need be, or NULL if every frame is pinned.
+void* vm_frame_allocate(struct spage* sp) {
+  struct thread* cur = thread_current();
+  void* upage = sp->upage;
+
   lock_acquire(&frame_lock); 
+
+  // A process at its resident limit makes room among its own frames,
+  // unless all of them are pinned
+  while(cur->rss_limit != 0 && cur->spt->rss >= cur->rss_limit && evict_frame(cur))
+    continue;
+
   void* fpage = palloc_get_page(PAL_USER);
 
-  if(fpage == NULL){
-    evict_frame(thread_current()->pagedir);
+  // The daemon fell behind, so evict synchronously.  Another thread can
+  // take the frame while it is written out, hence the loop.
+  while(fpage == NULL){
+    if(!evict_frame(NULL)){
+      if(transit_cnt == 0){
+        lock_release(&frame_lock);
+        return NULL;
+      }
+      cond_wait(&frame_freed, &frame_lock);
+    }
     fpage = palloc_get_page(PAL_USER);
   }
 
-  struct frame* f = malloc(sizeof(struct frame));
-
-  if(f == NULL){
-    lock_release(&frame_lock);
-    return NULL;
+  if(reclaim_started && !reclaim_pending && palloc_free_cnt(PAL_USER) < vm_frame_low_wm){
+    reclaim_pending = true;
+    sema_up(&reclaim_sema);
   }
 
-  f->t = thread_current();
+  struct frame* f = &frames[((uint8_t*)fpage - user_base) / PGSIZE];
+
+  ASSERT(!f->used);
+  f->t = cur;
   f->upage = upage;
-  f->kpage = fpage;
+  f->sp = sp;
+  f->maps = NULL;
+  f->refcnt = 1;
+  f->used = true;
   f->pinned = true;
-
-  hash_insert(&frame_hash, &f->elem);
-  list_push_back(&frame_list, &f->elem_);
+  f->text = false;
+  f->sequential = false;
+  f->transit = false;
+  f->last_use = cur->vtime;
+  pinned_cnt++;
+  frame_cnt++;
+  charge(cur, upage, 1);
 
   lock_release(&frame_lock);
   return fpage;
@@ -82,30 +574,29 @@ void vm_frame_deallocate(void *kpage, bool freep){
   if(lock_held_by_current_thread(&frame_lock)) lock = true;
   if(lock == false) lock_acquire(&frame_lock);
   
-  struct frame temp;
-
-  temp.kpage = kpage;
-
-  struct hash_elem *h = hash_find (&frame_hash, &(temp.elem));
-
-  struct frame* f = hash_entry(h, struct frame, elem);
+  struct frame* f = find_frame(kpage);
 
-  hash_delete(&frame_hash, &f->elem);
-  list_remove(&f->elem_);
+  ASSERT(f != NULL);
+  if(f->text) hash_delete(&text_hash, &f->text_elem);
+  if(f->pinned) pinned_cnt--;
+  while(f->maps != NULL){
+    struct frame_map* m = f->maps;
+    f->maps = m->next;
+    free(m);
+  }
+  f->used = false;
+  frame_cnt--;
+  charge(f->t, f->upage, -1);
 
   if(freep)palloc_free_page(kpage);
-  free(f);
   if(lock == false) lock_release(&frame_lock);
 }
 
 void vm_frame_pinning(void* kpage){
   lock_acquire(&frame_lock);
 
-  struct frame temp;
-  temp.kpage = kpage;
-  struct hash_elem* h = hash_find(&frame_hash, &(temp.elem));
-
-  struct frame* f = hash_entry(h, struct frame, elem);
+  struct frame* f = find_frame(kpage);
+  if(!f->pinned) pinned_cnt++;
   f->pinned = true;
 
   lock_release(&frame_lock);
@@ -114,12 +605,366 @@ void vm_frame_pinning(void* kpage){
 void vm_frame_unpinning(void* kpage){
   lock_acquire(&frame_lock);
 
-  struct frame temp;
-  temp.kpage = kpage;
-  struct hash_elem* h = hash_find(&frame_hash, &(temp.elem));
-
-  struct frame* f = hash_entry(h, struct frame, elem);
+  struct frame* f = find_frame(kpage);
+  if(f->pinned) pinned_cnt--;
   f->pinned = false;
   
   lock_release(&frame_lock);
 }
+
+// Pins the frame of SP, a page of the current process, waiting first if
+// it is being evicted.  Returns false if SP turns out to have no frame,
+// and then SP's type tells where the page went.
+bool vm_frame_pin_page(struct spage* sp){
+  struct frame* f;
+
+  lock_acquire(&frame_lock);
+  while(sp->type == FRAME && (f = find_frame(sp->kpage)) != NULL && f->transit)
+    wait_transit(f);
+  if(sp->type != FRAME){
+    lock_release(&frame_lock);
+    return false;
+  }
+  if(!f->pinned) pinned_cnt++;
+  f->pinned = true;
+  lock_release(&frame_lock);
+  return true;
+}
+
+// Waits until the frame of SP, if it has one, is not being evicted.
+void vm_frame_wait(struct spage* sp){
+  struct frame* f;
+
+  lock_acquire(&frame_lock);
+  while(sp->type == FRAME && (f = find_frame(sp->kpage)) != NULL && f->transit)
+    wait_transit(f);
+  lock_release(&frame_lock);
+}
+
+// Returns true if every page of the large-page region at BASE in T's
+// address space is a resident, writable, anonymous page with an
+// unpinned frame.
+static bool region_promotable(struct thread* t, uint8_t* base){
+  size_t i;
+
+  if(t->spt->pt_rss[pd_no(base)] != PTSPAN / PGSIZE) return false;
+  if(!pagedir_can_promote(t->pagedir, base)) return false;
+
+  for(i = 0; i < PTSPAN / PGSIZE; i++){
+    struct spage* sp = vm_find_spage(t->spt, base + i * PGSIZE);
+    if(sp == NULL || sp->type != FRAME || !sp->writable || sp->file != NULL) return false;
+
+    struct frame* f = find_frame(sp->kpage);
+    if(f == NULL || f->pinned || f->transit || f->refcnt != 1) return false;
+  }
+  return true;
+}
+
+// Backs the PTSPAN-byte region of T's address space at BASE with one
+// large page, if the whole region is populated by anonymous pages.
+// The frames are copied into an aligned, contiguous run of user pages
+// and the old frames are freed.  Nothing is evicted to make room, so
+// promotion only happens while 1024 aligned user pages are free: with
+// the default user pool it rarely does.
+// T must be the running thread, holding its page table's lock: the
+// frames are pinned, not locked, while they are copied, and only T could
+// write or share them.
+bool vm_frame_promote(struct thread* t, void* base){
+  uint8_t* kpages;
+  size_t i;
+
+  lock_acquire(&frame_lock);
+
+  if(!region_promotable(t, base)){
+    lock_release(&frame_lock);
+    return false;
+  }
+
+  kpages = palloc_get_aligned(PAL_USER, PTSPAN / PGSIZE, PTSPAN / PGSIZE);
+  if(kpages == NULL){
+    lock_release(&frame_lock);
+    return false;
+  }
+  for(i = 0; i < PTSPAN / PGSIZE; i++)
+    find_frame(vm_find_spage(t->spt, (uint8_t*)base + i * PGSIZE)->kpage)->pinned = true;
+  pinned_cnt += PTSPAN / PGSIZE;
+  lock_release(&frame_lock);
+
+  for(i = 0; i < PTSPAN / PGSIZE; i++)
+    memcpy(kpages + i * PGSIZE, vm_find_spage(t->spt, (uint8_t*)base + i * PGSIZE)->kpage, PGSIZE);
+
+  lock_acquire(&frame_lock);
+
+  if(!pagedir_promote(t->pagedir, base, kpages)){
+    for(i = 0; i < PTSPAN / PGSIZE; i++)
+      find_frame(vm_find_spage(t->spt, (uint8_t*)base + i * PGSIZE)->kpage)->pinned = false;
+    pinned_cnt -= PTSPAN / PGSIZE;
+    palloc_free_multiple(kpages, PTSPAN / PGSIZE);
+    lock_release(&frame_lock);
+    return false;
+  }
+
+  // Each entry moves to the slot of its new page; none is shared or text.
+  for(i = 0; i < PTSPAN / PGSIZE; i++){
+    struct spage* sp = vm_find_spage(t->spt, (uint8_t*)base + i * PGSIZE);
+    struct frame* f = find_frame(sp->kpage);
+    struct frame* nf = &frames[(kpages + i * PGSIZE - user_base) / PGSIZE];
+
+    palloc_free_page(sp->kpage);
+
+    *nf = *f;
+    nf->pinned = false;
+    f->used = false;
+    f->pinned = false;
+    sp->kpage = kpages + i * PGSIZE;
+  }
+  pinned_cnt -= PTSPAN / PGSIZE;
+
+  lock_release(&frame_lock);
+  return true;
+}
+
+// Returns true if T maps F at UPAGE.
+static bool frame_maps(struct frame* f, struct thread* t, void* upage){
+  struct frame_map* m;
+
+  if(f->t == t && f->upage == upage) return true;
+  for(m = f->maps; m != NULL; m = m->next)
+    if(m->t == t && m->upage == upage) return true;
+  return false;
+}
+
+// Adds M, filled in, to the end of F's mappings. frame_lock must be held.
+static void frame_add_map(struct frame* f, struct frame_map* m){
+  struct frame_map** mp = &f->maps;
+
+  while(*mp != NULL) mp = &(*mp)->next;
+  m->next = NULL;
+  *mp = m;
+  f->refcnt++;
+}
+
+// Removes T's mapping of F at UPAGE. frame_lock must be held.
+// If T was the first user, the oldest sharer takes its place, and the
+// frame is charged to it instead.
+static void frame_unmap(struct frame* f, struct thread* t, void* upage){
+  struct frame_map* m = NULL;
+  struct frame_map** mp;
+
+  if(f->t == t && f->upage == upage){
+    m = f->maps;
+    if(m != NULL){
+      f->maps = m->next;
+      f->t = m->t;
+      f->upage = m->upage;
+      f->sp = m->sp;
+      charge(t, upage, -1);
+      charge(f->t, f->upage, 1);
+      f->last_use = f->t->vtime;
+    }
+  }
+  else{
+    for(mp = &f->maps; *mp != NULL; mp = &(*mp)->next)
+      if((*mp)->t == t && (*mp)->upage == upage){
+        m = *mp;
+        *mp = m->next;
+        break;
+      }
+  }
+  free(m);
+  f->refcnt--;
+}
+
+// Maps frame KPAGE, which OWNER has at the same address, read-only in T
+// for SP, T's page, and write-protects OWNER's mapping, so that the
+// first write by either copies the frame.  Returns false if OWNER no
+// longer has the frame, because it was evicted, or if memory ran out.
+bool vm_frame_share(void* kpage, struct thread* owner, struct thread* t, struct spage* sp){
+  struct frame_map* m = malloc(sizeof *m);
+  void* upage = sp->upage;
+  struct frame* f;
+
+  if(m == NULL) return false;
+
+  lock_acquire(&frame_lock);
+  while((f = find_frame(kpage)) != NULL && f->transit) wait_transit(f);
+  if(f == NULL || !frame_maps(f, owner, upage) || !pagedir_set_page(t->pagedir, upage, kpage, false)){
+    lock_release(&frame_lock);
+    free(m);
+    return false;
+  }
+  pagedir_set_writable(owner->pagedir, upage, false);
+
+  m->t = t;
+  m->upage = upage;
+  m->sp = sp;
+  frame_add_map(f, m);
+  lock_release(&frame_lock);
+
+  return true;
+}
+
+// Drops T's mapping of frame KPAGE at UPAGE and frees the frame if no
+// one else maps it.  A frame that is still shared is unpinned.
+// If the frame is being evicted, waits for that instead: the page is
+// then in swap, and the caller must free its slot.
+void vm_frame_release(void* kpage, struct thread* t, void* upage){
+  struct frame* f;
+
+  lock_acquire(&frame_lock);
+  while((f = find_frame(kpage)) != NULL && f->transit) wait_transit(f);
+  if(f != NULL && frame_maps(f, t, upage)){
+    frame_unmap(f, t, upage);
+    if(f->refcnt == 0) vm_frame_deallocate(kpage, true);
+    else if(f->pinned){
+      f->pinned = false;
+      pinned_cnt--;
+    }
+  }
+  lock_release(&frame_lock);
+}
+
+// Resolves a write by T to UPAGE, which maps the copy-on-write frame
+// KPAGE read-only.  The last process sharing the frame gets it back
+// writable; the others get a private, writable copy.
+// Returns false if memory for the copy ran out.
+bool vm_frame_copy_on_write(struct thread* t, void* upage, void* kpage){
+  struct spage* sp;
+  struct frame* f;
+  bool was_pinned;
+  void* copy;
+
+  lock_acquire(&frame_lock);
+  f = find_frame(kpage);
+  if(f == NULL || f->transit || !frame_maps(f, t, upage)){
+    // Evicted meanwhile: the retried write takes a not-present fault
+    lock_release(&frame_lock);
+    return true;
+  }
+  if(f->refcnt == 1){
+    pagedir_set_writable(t->pagedir, upage, true);
+    lock_release(&frame_lock);
+    return true;
+  }
+
+  // Keep the frame in place while it is copied
+  was_pinned = f->pinned;
+  if(!was_pinned) pinned_cnt++;
+  f->pinned = true;
+  lock_release(&frame_lock);
+
+  sp = vm_find_spage(t->spt, upage);
+  copy = vm_frame_allocate(sp);
+  if(copy != NULL) memcpy(copy, kpage, PGSIZE);
+
+  lock_acquire(&frame_lock);
+  if(copy == NULL){
+    if(!was_pinned) pinned_cnt--;
+    f->pinned = was_pinned;
+    lock_release(&frame_lock);
+    return false;
+  }
+
+  frame_unmap(f, t, upage);
+  if(f->refcnt == 0) vm_frame_deallocate(kpage, true);
+  else{
+    if(!was_pinned) pinned_cnt--;
+    f->pinned = was_pinned;
+  }
+
+  pagedir_clear_page(t->pagedir, upage);
+  pagedir_set_page(t->pagedir, upage, copy, true);
+  // The copy may hold writes from before the fork, which only the old
+  // PTE's dirty bit recorded, and the write being retried changes it
+  sp->kpage = copy;
+  sp->dirty = true;
+  vm_spage_drop_swap_slot(sp);
+
+  f = find_frame(copy);
+  f->pinned = false;
+  pinned_cnt--;
+  lock_release(&frame_lock);
+
+  return true;
+}
+
+// Looks up the page of SP, a FILE_SYS page of T's read-only text, in the
+// text cache.  If another process has it resident, maps that frame
+// read-only in T and makes SP refer to it.  Returns false on a miss.
+bool vm_frame_attach_text(struct thread* t, struct spage* sp){
+  struct frame_map* m = malloc(sizeof *m);
+  struct hash_elem* h;
+  struct frame temp;
+  struct frame* f;
+
+  if(m == NULL) return false;
+
+  temp.text_inumber = inode_get_inumber(file_get_inode(sp->file));
+  temp.text_offset = sp->offset;
+
+  lock_acquire(&frame_lock);
+  h = hash_find(&text_hash, &temp.text_elem);
+  f = h != NULL ? hash_entry(h, struct frame, text_elem) : NULL;
+  if(f == NULL || !pagedir_set_page(t->pagedir, sp->upage, frame_kpage(f), false)){
+    lock_release(&frame_lock);
+    free(m);
+    return false;
+  }
+
+  m->t = t;
+  m->upage = sp->upage;
+  m->sp = sp;
+  frame_add_map(f, m);
+  sp->kpage = frame_kpage(f);
+  sp->type = FRAME;
+  text_hit_cnt++;
+  lock_release(&frame_lock);
+
+  return true;
+}
+
+// Enters frame KPAGE, just read in for SP, a FILE_SYS page of read-only
+// text, into the text cache, unless another process got there first.
+void vm_frame_set_text(void* kpage, struct spage* sp){
+  struct frame* f;
+
+  lock_acquire(&frame_lock);
+  f = find_frame(kpage);
+  f->text_inumber = inode_get_inumber(file_get_inode(sp->file));
+  f->text_offset = sp->offset;
+  f->text = hash_insert(&text_hash, &f->text_elem) == NULL;
+  lock_release(&frame_lock);
+}
+
+// Marks frame KPAGE as part of a MADV_SEQUENTIAL range, or not.
+// Does nothing if it was evicted meanwhile.
+void vm_frame_set_sequential(void* kpage, bool sequential){
+  struct frame* f;
+
+  lock_acquire(&frame_lock);
+  f = find_frame(kpage);
+  if(f != NULL) f->sequential = sequential;
+  lock_release(&frame_lock);
+}
+
+// Fills in the frame table fields of INFO.
+// frame_lock is not taken because this also runs on the panic path.
+void vm_frame_get_meminfo(struct meminfo* info){
+  info->frame_cnt = frame_cnt;
+  info->frame_pinned = pinned_cnt;
+}
+
+void vm_frame_print_stats(void){
+  struct meminfo info;
+
+  vm_frame_get_meminfo(&info);
+  printf("Frame: %zu frames, %zu pinned, %zu text frames shared %llu times\n",
+         info.frame_cnt, info.frame_pinned, hash_size(&text_hash), text_hit_cnt);
+  printf("Frame: %llu mmap pages written back by flusher\n", flush_cnt);
+  printf("Frame: %llu waits for pages being evicted\n", transit_wait_cnt);
+  printf("Frame: %llu clean file pages dropped instead of swapped\n", file_discard_cnt);
+  printf("Frame: %llu clean swapped-in pages evicted to their slot again\n", swap_cache_hit_cnt);
+  if(vm_frame_wsclock)
+    printf("Frame: WSClock, %lld tick window, %llu working-set scans\n",
+           vm_frame_ws_window, ws_scan_cnt);
+}
@@ -3,6 +3,7 @@
 
 #include <hash.h>
 #include <list.h>
+#include <meminfo.h>
 #include "lib/kernel/hash.h"
 #include "lib/kernel/list.h"
 
@@ -11,30 +12,69 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
+#include "devices/block.h"
+#include "filesys/off_t.h"
 #include "userprog/pagedir.h"
 #include "vm/page.h"
 
-// Entry of Frame Table
+struct spage;
+
+// Entry of Frame Table, one for each page of the user pool.  The
+// frame's kernel page follows from the entry's index.
 struct frame {
-  void* kpage;
   void* upage;
+  struct thread* t;
+  struct spage* sp;         // T's page at UPAGE
+  struct frame_map* maps;   // Further mappings, shared copy-on-write or as text
 
-  struct hash_elem elem;
-  struct list_elem elem_;
+  unsigned refcnt : 16;     // Mappings of the frame: T's, plus one per MAPS entry
+  unsigned used : 1;        // Holds a page of a process
+  unsigned pinned : 1;
+  unsigned text : 1;        // In the text cache
+  unsigned sequential : 1;  // Page of a MADV_SEQUENTIAL range
+  unsigned transit : 1;     // Detached from its pages, being written to swap
 
-  struct thread* t;
+  int64_t last_use;         // Virtual time of T when last seen accessed
+
+  // Read-only executable page shared through the text cache
+  block_sector_t text_inumber;  // Inode of the executable
+  off_t text_offset;            // Offset of the page in it
+  struct hash_elem text_elem;   // Element in text_hash
+};
 
-  bool pinned;
+// Mapping of a frame by a process other than the frame's first user
+struct frame_map {
+  struct thread* t;
+  void* upage;
+  struct spage* sp;         // T's page at UPAGE
+  struct frame_map* next;
 };
 
+extern size_t vm_frame_low_wm;
+extern size_t vm_frame_high_wm;
+extern bool vm_frame_wsclock;
+extern int64_t vm_frame_ws_window;
+
 // Frame Manipulate Functions
 
 void vm_frame_init(void);
-void* vm_frame_allocate(void* upage);
+void vm_frame_reclaim_init(void);
+void vm_frame_flush_init(void);
+void* vm_frame_allocate(struct spage* sp);
 void vm_frame_deallocate(void* kpage, bool freep);
-void vm_frame_remove_entry(void* kpage);
 void vm_frame_pinning(void* kpage);
 void vm_frame_unpinning(void* kpage);
+bool vm_frame_pin_page(struct spage* sp);
+void vm_frame_wait(struct spage* sp);
+bool vm_frame_promote(struct thread* t, void* base);
+bool vm_frame_share(void* kpage, struct thread* owner, struct thread* t, struct spage* sp);
+void vm_frame_release(void* kpage, struct thread* t, void* upage);
+bool vm_frame_copy_on_write(struct thread* t, void* upage, void* kpage);
+bool vm_frame_attach_text(struct thread* t, struct spage* sp);
+void vm_frame_set_text(void* kpage, struct spage* sp);
+void vm_frame_set_sequential(void* kpage, bool sequential);
+void vm_frame_get_meminfo(struct meminfo* info);
+void vm_frame_print_stats(void);
 
 
 #endif
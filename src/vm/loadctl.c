@@ -0,0 +1,143 @@
+#include "vm/loadctl.h"
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "vm/page.h"
+#include "vm/vmstat.h"
+
+// Load control: every LOADCTL_INTERVAL ticks, looks at the major faults
+// (swap and file reads) of the interval.  With at least THRASH_FAULTS of
+// them, half of which are short refaults, the system is thrashing and
+// one process is suspended.  Otherwise, one suspended process is
+// resumed, so that none waits for faults to drop below some level that
+// the others never reach.
+#define LOADCTL_INTERVAL (TIMER_FREQ / 2)
+#define THRASH_FAULTS 32
+
+// Evictions so far; pages remember the count when they are evicted
+static uint32_t evict_seq;
+
+// A refault is short if fewer evictions than there are user frames
+// happened in between: with twice the memory, the page would have stayed.
+static size_t user_frames;
+
+// Short refaults of the current interval
+static unsigned short_refault_cnt;
+
+static unsigned long long refault_total;
+static unsigned long long short_refault_total;
+
+static unsigned long long suspend_cnt;
+static unsigned long long resume_cnt;
+
+// Running and suspended user processes, with the one to suspend next:
+// lowest priority first, then largest resident set; and the one to
+// resume next: smallest resident set first.
+struct census{
+  size_t running;
+  size_t suspended;
+  struct thread* victim;
+  struct thread* resume;
+};
+
+static void take_census(struct thread* t, void* aux){
+  struct census* c = aux;
+
+  if(t->pagedir == NULL || t->spt == NULL || t->status == THREAD_DYING) return;
+
+  if(t->suspended){
+    c->suspended++;
+    if(c->resume == NULL || t->spt->rss < c->resume->spt->rss) c->resume = t;
+    return;
+  }
+  c->running++;
+  if(c->victim == NULL || t->priority < c->victim->priority
+     || (t->priority == c->victim->priority && t->spt->rss > c->victim->spt->rss))
+    c->victim = t;
+}
+
+// Lets T run again. Interrupts must be off.
+static void resume(struct thread* t){
+  t->suspended = false;
+  if(t->parked){
+    t->parked = false;
+    thread_unblock(t);
+  }
+  resume_cnt++;
+}
+
+static void loadctl_daemon(void* aux UNUSED){
+  unsigned last = vm_stat_major_faults();
+
+  for(;;){
+    struct census c = { 0, 0, NULL, NULL };
+    unsigned now, faults, short_refaults;
+    enum intr_level old_level;
+    bool thrashing;
+
+    timer_sleep(LOADCTL_INTERVAL);
+
+    old_level = intr_disable();
+    now = vm_stat_major_faults();
+    faults = now - last;
+    last = now;
+    short_refaults = short_refault_cnt;
+    short_refault_cnt = 0;
+
+    thread_foreach(take_census, &c);
+    thrashing = faults >= THRASH_FAULTS && short_refaults * 2 >= faults;
+    // Never suspend the last running process
+    if(thrashing && c.running > 1){
+      c.victim->suspended = true;
+      suspend_cnt++;
+    }
+    else if(c.suspended > 0 && (!thrashing || c.running == 0))
+      resume(c.resume);
+    intr_set_level(old_level);
+  }
+}
+
+// Starts load control. Must be called after vm_frame_init().
+void vm_loadctl_init(void){
+  palloc_user_pool(&user_frames);
+  thread_create("loadctl", PRI_DEFAULT, loadctl_daemon, NULL);
+}
+
+// Counts an eviction and returns its sequence number, never 0, for the
+// evicted page to remember.  frame_lock is held.
+uint32_t vm_loadctl_evicted(void){
+  if(++evict_seq == 0) evict_seq = 1;
+  return evict_seq;
+}
+
+// Records a fault on a page evicted with sequence number EVICTED_AT.
+void vm_loadctl_refault(uint32_t evicted_at){
+  enum intr_level old_level = intr_disable();
+
+  refault_total++;
+  if(evict_seq - evicted_at < user_frames){
+    short_refault_cnt++;
+    short_refault_total++;
+  }
+  intr_set_level(old_level);
+}
+
+// Suspends the current process here if load control chose it.  It must
+// hold no locks: page_fault() calls this for faults from user mode.
+void vm_loadctl_checkpoint(void){
+  struct thread* cur = thread_current();
+  enum intr_level old_level = intr_disable();
+
+  while(cur->suspended){
+    cur->parked = true;
+    thread_block();
+  }
+  intr_set_level(old_level);
+}
+
+void vm_loadctl_print_stats(void){
+  printf("Load control: %llu refaults, %llu short; %llu suspensions, %llu resumptions\n",
+         refault_total, short_refault_total, suspend_cnt, resume_cnt);
+}
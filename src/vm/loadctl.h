@@ -0,0 +1,12 @@
+#ifndef VM_LOADCTL_H
+#define VM_LOADCTL_H
+
+#include <stdint.h>
+
+void vm_loadctl_init(void);
+uint32_t vm_loadctl_evicted(void);
+void vm_loadctl_refault(uint32_t evicted_at);
+void vm_loadctl_checkpoint(void);
+void vm_loadctl_print_stats(void);
+
+#endif
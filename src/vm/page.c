@@ -1,4 +1,17 @@
 #include "vm/page.h"
+#include <madvise.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/pte.h"
+#include "vm/loadctl.h"
+#include "vm/swap.h"
+
+// Pages read by a FILE_SYS fault: the first window, and the most
+#define FAULT_AROUND_INIT 4
+#define FAULT_AROUND_MAX 16
+
+// Read-only page of zeros mapped for reads of ZERO pages never written
+static void* zero_page;
 
 static unsigned hash_func(const struct hash_elem* elem, void* aux){
   struct spage* s = hash_entry(elem, struct spage, elem);
@@ -11,69 +24,358 @@ static bool less_func(const struct hash_elem* x, const struct hash_elem* y, void
   return x_->upage < y_->upage;
 }
 
+// Frees S, whose frame vm_spage_table_destroy() already released.
 static void destroy_func(struct hash_elem* elem, void* aux){
   struct spage *s = hash_entry(elem, struct spage, elem);
 
-  if(s->kpage != NULL) vm_frame_deallocate(s->kpage, false);
-  else if(s->type == SWAP) vm_swap_free (s->sector_index);
+  if(s->type == SWAP || s->swap_cached) vm_swap_free (s->sector_index);
 
   free(s);
 }
 
+void vm_page_init(){
+  zero_page = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+}
+
 struct spage_table* vm_spage_table_create(){
   struct spage_table* spt = (struct spage_table*) malloc(sizeof(struct spage_table));
 
+  lock_init(&spt->lock);
   hash_init(&spt->page_hash, hash_func, less_func, NULL);
+  spt->regions = NULL;
+  spt->fault_next = NULL;
+  spt->fault_window = FAULT_AROUND_INIT;
+  memset(&spt->faults, 0, sizeof spt->faults);
+  spt->heap_start = spt->brk = NULL;
+  spt->rss = 0;
+  spt->rss_peak = 0;
+  spt->rss_hand = 0;
+  spt->rss_evict_cnt = 0;
+  memset(spt->pt_rss, 0, sizeof spt->pt_rss);
   return spt;
 }
 
+// Frames are released while every page is still in the hash: a frame
+// being written to swap is waited for, and the evictor then makes the
+// page SWAP, so that destroy_func() frees the slot.  Once no frame
+// refers to the pages, the lock is no longer needed.
 void vm_spage_table_destroy(struct spage_table *spt){
+  struct hash_iterator i;
+
+  lock_acquire(&spt->lock);
+  hash_first(&i, &spt->page_hash);
+  while(hash_next(&i)){
+    struct spage* sp = hash_entry(hash_cur(&i), struct spage, elem);
+
+    if(sp->kpage == NULL) continue;
+    vm_frame_release(sp->kpage, thread_current(), sp->upage);
+    if(sp->type == FRAME) sp->kpage = NULL;
+  }
+  lock_release(&spt->lock);
   hash_destroy (&spt->page_hash, destroy_func);
+  vm_region_destroy(&spt->regions);
   free(spt);
 }
 
+// Acquires the lock of SPT unless the running thread holds it already,
+// as it does when a kernel access faults in a call that took it.
+// Returns whether it was acquired, for vm_spage_table_unlock().
+bool vm_spage_table_lock(struct spage_table* spt){
+  if(lock_held_by_current_thread(&spt->lock)) return false;
+  lock_acquire(&spt->lock);
+  return true;
+}
+
+// Releases the lock of SPT if LOCKED, as vm_spage_table_lock() returned.
+void vm_spage_table_unlock(struct spage_table* spt, bool locked){
+  if(locked) lock_release(&spt->lock);
+}
+
+// Enters UPAGE into SPT.  SPT's lock must be held.
 void vm_spage_table_install(struct spage_table* spt, enum page_type type,
 		void* upage, void* kpage, uint32_t sector_index, struct file* file,
 		off_t offset, uint32_t read_bytes, uint32_t zero_bytes, bool writable){
   
-  struct spage* sp;
-  if(type == SWAP) sp = vm_find_spage(spt, upage);
-  else sp = (struct spage*)malloc(sizeof(struct spage));
+  struct spage* sp = (struct spage*)malloc(sizeof(struct spage));
 
+  ASSERT(lock_held_by_current_thread(&spt->lock));
   sp->type = type;
   sp->kpage = kpage;
   sp->sector_index = sector_index;
-  if(type!=SWAP){
-    sp->upage = upage;
-    sp->file = file;
-    sp->offset = offset;
-    sp->read_bytes = read_bytes;
-    sp->zero_bytes = zero_bytes;
-    sp->writable = writable;
-    sp->dirty = NULL;
-    hash_insert(&spt->page_hash, &sp->elem);
-  }
+  sp->swap_cached = false;
+  sp->upage = upage;
+  sp->file = file;
+  sp->offset = offset;
+  sp->read_bytes = read_bytes;
+  sp->zero_bytes = zero_bytes;
+  sp->writable = writable;
+  sp->mmap = false;
+  sp->sequential = false;
+  sp->evicted_at = 0;
+  sp->dirty = NULL;
+  hash_insert(&spt->page_hash, &sp->elem);
 }
 
-struct spage* vm_find_spage(struct spage_table* spt, void* upage){
+// Returns the entry of UPAGE in SPT's page hash, or NULL.  Pages of a
+// region that were never faulted in have none.  SPT's lock must be held.
+static struct spage* lookup_spage(struct spage_table* spt, void* upage){
   struct spage temp;
   temp.upage = upage;
 
+  ASSERT(lock_held_by_current_thread(&spt->lock));
   struct hash_elem* elem = hash_find (&spt->page_hash, &temp.elem);
   if(elem == NULL) return NULL;
   else return hash_entry(elem, struct spage, elem);
 }
 
-bool vm_load_page(struct spage_table* spt, uint32_t* pagedir, void* upage){
+// Returns the entry of UPAGE in SPT, creating it as a FILE_SYS page if
+// UPAGE lies in a region and has none yet.  Returns NULL if UPAGE is not
+// mapped, or if memory ran out.
+struct spage* vm_find_spage(struct spage_table* spt, void* upage){
+  struct spage* sp = lookup_spage(spt, upage);
+  struct vm_region* r;
+  size_t ofs, read_bytes;
+
+  if(sp != NULL) return sp;
+  r = vm_region_find(spt->regions, upage);
+  if(r == NULL) return NULL;
+
+  sp = malloc(sizeof *sp);
+  if(sp == NULL) return NULL;
+
+  ofs = (uint8_t*)upage - r->start;
+  read_bytes = ofs < r->read_bytes ? r->read_bytes - ofs : 0;
+  if(read_bytes > PGSIZE) read_bytes = PGSIZE;
+
+  sp->type = FILE_SYS;
+  sp->kpage = NULL;
+  sp->sector_index = 0;
+  sp->swap_cached = false;
+  sp->upage = upage;
+  sp->file = r->file;
+  sp->offset = r->offset + ofs;
+  sp->read_bytes = read_bytes;
+  sp->zero_bytes = PGSIZE - read_bytes;
+  sp->writable = r->writable;
+  sp->mmap = r->mmap;
+  sp->sequential = false;
+  sp->evicted_at = 0;
+  sp->dirty = false;
+  hash_insert(&spt->page_hash, &sp->elem);
+  return sp;
+}
+
+// Deletes SP, a page of SPT the evictor just turned back into a FILE_SYS
+// page, if it lies in a region, which makes a new entry on the next
+// fault, so that entries do not pile up for pages read once.  Pages
+// with a MADV_SEQUENTIAL hint keep their entries, and with them the
+// hint.  The evictor does not wait for SPT's lock: while SPT is in use,
+// SP is kept.
+void vm_spage_table_forget(struct spage_table* spt, struct spage* sp){
+  if(sp->sequential) return;
+  if(lock_held_by_current_thread(&spt->lock) || !lock_try_acquire(&spt->lock)) return;
+  if(vm_region_find(spt->regions, sp->upage) != NULL){
+    hash_delete(&spt->page_hash, &sp->elem);
+    free(sp);
+  }
+  lock_release(&spt->lock);
+}
+
+// Lets go of the swap slot SP kept when it was swapped in, because the
+// page was written or its dirty bits are about to be cleared.
+void vm_spage_drop_swap_slot(struct spage* sp){
+  if(!sp->swap_cached) return;
+  vm_swap_free(sp->sector_index);
+  sp->swap_cached = false;
+}
+
+// Maps the LENGTH bytes at UPAGE, rounded up to whole pages, from FILE
+// at OFFSET: the first READ_BYTES bytes are read from FILE and the rest
+// zeroed.  Pages get their entries when first faulted in.
+// Executable segments may share their boundary page.  If the earlier
+// segment goes on in the file where the new one starts, the two become
+// one region; otherwise the earlier one keeps the page.
+// Returns false if the range overlaps another mapping or memory ran out.
+bool vm_spage_table_map(struct spage_table* spt, void* upage, size_t length,
+		struct file* file, off_t offset, size_t read_bytes, bool writable, bool mmap){
+  uint8_t* start = upage;
+  uint8_t* end = start + ROUND_UP(length, PGSIZE);
+  struct vm_region* r;
+
+  ASSERT(pg_ofs(upage) == 0);
+  ASSERT(lock_held_by_current_thread(&spt->lock));
+
+  if(end < start || !is_user_vaddr(end - 1)) return false;
+
+  r = mmap ? NULL : vm_region_find(spt->regions, start);
+  if(r != NULL){
+    size_t skip = r->end - start;
+
+    if(r->file == file && r->writable == writable && !r->mmap
+       && r->offset + (off_t)(start - r->start) == offset
+       && !vm_region_overlaps(spt->regions, r->end, end)){
+      size_t bytes = (start - r->start) + read_bytes;
+      if(bytes > r->read_bytes) r->read_bytes = bytes;
+      if(end > r->end) r->end = end;
+      return true;
+    }
+    if(skip >= (size_t)(end - start)) return true;
+    start += skip;
+    offset += skip;
+    read_bytes = read_bytes > skip ? read_bytes - skip : 0;
+  }
+  if(vm_region_overlaps(spt->regions, start, end)) return false;
+  // Heap pages have entries but no region
+  if(spt->heap_start < (uint8_t*)pg_round_up(spt->brk)
+     && start < (uint8_t*)pg_round_up(spt->brk) && spt->heap_start < end) return false;
+
+  r = malloc(sizeof *r);
+  if(r == NULL) return false;
+  r->start = start;
+  r->end = end;
+  r->file = file;
+  r->offset = offset;
+  r->read_bytes = read_bytes;
+  r->writable = writable;
+  r->mmap = mmap;
+  vm_region_insert(&spt->regions, r);
+  return true;
+}
+
+// Forgets the region starting at UPAGE.  Its pages' entries must have
+// been removed already.
+void vm_spage_table_unmap(struct spage_table* spt, void* upage){
+  struct vm_region* r = vm_region_find(spt->regions, upage);
+
+  ASSERT(lock_held_by_current_thread(&spt->lock));
+  if(r == NULL) return;
+  vm_region_remove(&spt->regions, r);
+  free(r);
+}
+
+// Returns the number of pages of SPT that currently own a frame.
+size_t vm_spage_table_resident(struct spage_table* spt){
+  struct hash_iterator i;
+  size_t cnt = 0;
+
+  ASSERT(lock_held_by_current_thread(&spt->lock));
+  hash_first(&i, &spt->page_hash);
+  while(hash_next(&i)){
+    struct spage* sp = hash_entry(hash_cur(&i), struct spage, elem);
+    if(sp->type == FRAME) cnt++;
+  }
+  return cnt;
+}
+
+// Returns how many pages a FILE_SYS fault at SP should read, and adapts
+// the window of SPT: it doubles while each fault lands just past the
+// run read by the previous one and halves when faults jump around.
+static size_t fault_around_window(struct spage_table* spt, struct spage* sp){
+  if(sp->sequential) spt->fault_window = FAULT_AROUND_MAX;
+  else if(sp->upage == spt->fault_next){
+    if(spt->fault_window < FAULT_AROUND_MAX) spt->fault_window *= 2;
+  }
+  else if(spt->fault_window > 1) spt->fault_window /= 2;
+
+  return spt->fault_window;
+}
+
+// Returns the length, up to MAX pages, of the run of FILE_SYS pages
+// starting at SP that continue the same stretch of the same file.
+static size_t file_run(struct spage_table* spt, struct spage* sp, size_t max){
+  struct spage* prev = sp;
+  size_t n;
+
+  for(n = 1; n < max && prev->read_bytes == PGSIZE; n++){
+    struct spage* next = vm_find_spage(spt, (uint8_t*)sp->upage + n * PGSIZE);
+
+    if(next == NULL || next->type != FILE_SYS || next->file != sp->file
+       || next->offset != sp->offset + (off_t)(n * PGSIZE)
+       || next->writable != sp->writable || next->mmap != sp->mmap) break;
+    prev = next;
+  }
+  return n;
+}
+
+// Returns true if SP is a page of program text not loaded yet: such
+// pages are shared by every process running the same executable.
+static bool is_text(struct spage* sp){
+  return sp->type == FILE_SYS && !sp->writable && !sp->mmap;
+}
+
+// Reads the FILE_SYS page SP into FPAGE, zeroing what lies past its
+// bytes in the file.
+static void read_file_page(struct spage* sp, uint8_t* fpage){
+  size_t bytes = file_read_at(sp->file, fpage, sp->read_bytes, sp->offset);
+  memset(fpage + bytes, 0, PGSIZE - bytes);
+}
+
+// Reads SP, a FILE_SYS page, into FPAGE.  Unless user frames are short,
+// the pages following it in the same file, up to the fault-around
+// window, are read and mapped as well, each straight into a frame of
+// its own.  Text pages another process has resident are mapped instead.
+static void load_file_pages(struct spage_table* spt, uint32_t* pagedir, struct spage* sp, void* fpage){
+  size_t window = fault_around_window(spt, sp);
+  size_t n = 1, i;
+
+  if(window > 1 && palloc_free_cnt(PAL_USER) > vm_frame_high_wm + window)
+    n = file_run(spt, sp, window);
+
+  read_file_page(sp, fpage);
+
+  for(i = 1; i < n; i++){
+    struct spage* next = vm_find_spage(spt, (uint8_t*)sp->upage + i * PGSIZE);
+    bool text = is_text(next);
+    void* kpage;
+
+    if(text && vm_frame_attach_text(thread_current(), next)) continue;
+    kpage = vm_frame_allocate(next);
+    if(kpage == NULL) break;
+    read_file_page(next, kpage);
+    if(!pagedir_set_page(pagedir, next->upage, kpage, next->writable)){
+      vm_frame_deallocate(kpage, true);
+      break;
+    }
+    next->kpage = kpage;
+    next->type = FRAME;
+    pagedir_set_dirty(pagedir, kpage, false);
+    if(text) vm_frame_set_text(kpage, next);
+    if(next->sequential) vm_frame_set_sequential(kpage, true);
+    vm_frame_unpinning(kpage);
+  }
+  spt->fault_next = (uint8_t*)sp->upage + i * PGSIZE;
+}
+
+// Brings in UPAGE after a not-present fault, a write fault if WRITE.
+// Reads of a ZERO page map the shared zero page; it stays ZERO, without
+// a frame, until the first write.  Sets *TEXT_HIT, unless TEXT_HIT is
+// NULL, if the page was program text another process had resident.
+bool vm_load_page(struct spage_table* spt, uint32_t* pagedir, void* upage, bool write, bool* text_hit){
   struct spage* sp = vm_find_spage(spt, upage);
 
   if(sp == NULL) return false;
+  // A page being evicted is read back once it is in swap
+  if(sp->type == FRAME) vm_frame_wait(sp);
   if(sp->type == FRAME) return true;
+  if(sp->type == ZERO && !write)
+    return pagedir_set_page(pagedir, upage, zero_page, false);
 
-  void* fpage = vm_frame_allocate(upage);
+  bool text = is_text(sp);
+  if(text && vm_frame_attach_text(thread_current(), sp)){
+    if(text_hit != NULL) *text_hit = true;
+    return true;
+  }
+
+  void* fpage = vm_frame_allocate(sp);
   
   if(fpage == NULL) return false;
 
+  // For load control's refault distance
+  if(sp->evicted_at != 0){
+    vm_loadctl_refault(sp->evicted_at);
+    sp->evicted_at = 0;
+  }
+
   switch(sp->type){
     case ZERO:
       memset(fpage, 0, PGSIZE);
@@ -84,13 +386,14 @@ bool vm_load_page(struct spage_table* spt, uint32_t* pagedir, void* upage){
       break;
 
     case SWAP:
-      vm_swap_in(sp->sector_index, fpage);
-      pagedir_set_page(pagedir, upage, fpage, true);
+      // The slot stays with the page until it is written
+      vm_swap_read(sp->sector_index, fpage);
+      pagedir_set_page(pagedir, upage, fpage, sp->writable);
+      sp->swap_cached = true;
       break;
 
     case FILE_SYS:
-      file_seek(sp->file, sp->offset);
-      memset(fpage + file_read(sp->file,fpage,sp->read_bytes), 0, sp->zero_bytes);
+      load_file_pages(spt, pagedir, sp, fpage);
       pagedir_set_page(pagedir, upage, fpage, sp->writable);
       break;
   }
@@ -98,19 +401,158 @@ bool vm_load_page(struct spage_table* spt, uint32_t* pagedir, void* upage){
   sp->type = FRAME;
 
   pagedir_set_dirty(pagedir, fpage, false);
+  if(text) vm_frame_set_text(fpage, sp);
+  if(sp->sequential) vm_frame_set_sequential(fpage, true);
 
   vm_frame_unpinning(fpage);
+
+  // An anonymous region whose last missing page this was becomes a large
+  // page.  vm_frame_promote() checks the others.
+  if(sp->writable && sp->file == NULL && spt->pt_rss[pd_no(upage)] == PTSPAN / PGSIZE)
+    vm_frame_promote(thread_current(), (void*)((uintptr_t)upage & ~(uintptr_t)(PTSPAN - 1)));
   
   return true;
 }
 
-void vm_spage_table_mm_unmap(struct spage_table* spt, uint32_t* pagedir, void* page, struct file* f, off_t offset, size_t bytes){ 
-  struct spage* sp = vm_find_spage(spt, page);
+// Writes PAGE of a mapping of F back to F if it is dirty, for msync().
+// A dirty page in swap is written from a bounce buffer and becomes a
+// clean FILE_SYS page again.
+void vm_spage_table_mm_sync(struct spage_table* spt, uint32_t* pagedir, void* page, struct file* f, off_t offset, size_t bytes){
+  struct spage* sp = lookup_spage(spt, page);
+
+  if(sp == NULL) return;
+
+  if(sp->type == FRAME && vm_frame_pin_page(sp)){
+    void* kpage = sp->kpage;
+
+    if(sp->dirty || pagedir_is_dirty(pagedir, sp->upage) || pagedir_is_dirty(pagedir, kpage)){
+      vm_spage_drop_swap_slot(sp);
+      sp->dirty = false;
+      pagedir_set_dirty(pagedir, sp->upage, false);
+      pagedir_set_dirty(pagedir, kpage, false);
+      file_write_at(f, kpage, bytes, offset);
+    }
+    vm_frame_unpinning(kpage);
+  }
+  else if(sp->type == SWAP && (sp->dirty || pagedir_is_dirty(pagedir, sp->upage))){
+    void* temp = palloc_get_page(0);
+
+    if(temp == NULL) return;
+    vm_swap_in(sp->sector_index, temp);
+    file_write_at(f, temp, bytes, offset);
+    palloc_free_page(temp);
+    sp->type = FILE_SYS;
+    sp->dirty = false;
+    pagedir_set_dirty(pagedir, sp->upage, false);
+  }
+}
+
+// Throws away the contents of SP for MADV_DONTNEED, writing it back
+// first if it belongs to a mmap region.  Its frame or swap slot is
+// freed, and the page is read from its file or zeroed on next use.
+static void discard_page(struct spage_table* spt, uint32_t* pagedir, struct spage* sp){
+  if(sp->mmap) vm_spage_table_mm_sync(spt, pagedir, sp->upage, sp->file, sp->offset, sp->read_bytes);
+
+  if(sp->type == FRAME && vm_frame_pin_page(sp)){
+    pagedir_clear_page(pagedir, sp->upage);
+    vm_frame_release(sp->kpage, thread_current(), sp->upage);
+    vm_spage_drop_swap_slot(sp);
+  }
+  else if(sp->type == SWAP) vm_swap_free(sp->sector_index);
+  else pagedir_clear_page(pagedir, sp->upage);  // Maybe the zero page
+
+  sp->type = sp->file != NULL ? FILE_SYS : ZERO;
+  sp->kpage = NULL;
+  sp->dirty = false;
+  pagedir_set_dirty(pagedir, sp->upage, false);
+}
+
+// Applies ADVICE, one of the MADV_* hints, to the pages of SPT from
+// ADDR, which must be page-aligned, through ADDR + LEN.  Pages in the
+// range that were never mapped are skipped.  MADV_WILLNEED stops
+// prefetching once free user frames drop to the reclaim daemon's high
+// watermark.  Returns false if the arguments are invalid.
+bool vm_spage_table_advise(struct spage_table* spt, uint32_t* pagedir, void* addr, size_t len, int advice){
+  uint8_t* upage;
+  uint8_t* end = (uint8_t*)addr + len;
+
+  if(pg_ofs(addr) || end < (uint8_t*)addr || !is_user_vaddr(end - 1)) return false;
+  if(advice != MADV_NORMAL && advice != MADV_SEQUENTIAL
+     && advice != MADV_WILLNEED && advice != MADV_DONTNEED) return false;
+
+  for(upage = addr; upage < end; upage += PGSIZE){
+    // Pages never faulted in have nothing to throw away
+    struct spage* sp = advice == MADV_DONTNEED ? lookup_spage(spt, upage) : vm_find_spage(spt, upage);
+
+    if(sp == NULL) continue;
+    switch(advice){
+      case MADV_NORMAL:
+      case MADV_SEQUENTIAL:
+        sp->sequential = advice == MADV_SEQUENTIAL;
+        if(sp->type == FRAME) vm_frame_set_sequential(sp->kpage, sp->sequential);
+        break;
+
+      case MADV_WILLNEED:
+        if(sp->type != FILE_SYS && sp->type != SWAP) break;
+        if(palloc_free_cnt(PAL_USER) <= vm_frame_high_wm) return true;
+        vm_load_page(spt, pagedir, upage, false, NULL);
+        break;
+
+      case MADV_DONTNEED:
+        discard_page(spt, pagedir, sp);
+        // The region makes a new entry on the next fault
+        if(vm_region_find(spt->regions, upage) != NULL){
+          hash_delete(&spt->page_hash, &sp->elem);
+          free(sp);
+        }
+        break;
+    }
+  }
+  return true;
+}
+
+// Moves the program break of SPT by INCREMENT bytes and returns the old
+// break.  New heap pages are ZERO pages; pages wholly above the new
+// break are thrown away.  Returns NULL, changing nothing, if SPT has no
+// heap, if the break would drop below the start of the heap, or if the
+// heap would run into another mapping or the stack area.
+void* vm_spage_table_sbrk(struct spage_table* spt, uint32_t* pagedir, intptr_t increment){
+  uint8_t* old = spt->brk;
+  uint8_t* new = old + increment;
+  uint8_t* old_end = pg_round_up(old);
+  uint8_t* new_end = pg_round_up(new);
+  uint8_t* upage;
+
+  if(spt->heap_start == NULL) return NULL;
+  if((increment > 0 && new < old) || (increment < 0 && new > old) || new < spt->heap_start) return NULL;
+
+  if(new_end > old_end){
+    if(new_end > (uint8_t*)PHYS_BASE - MAX_STACK_SIZE) return NULL;
+    for(upage = old_end; upage < new_end; upage += PGSIZE)
+      if(vm_find_spage(spt, upage) != NULL) return NULL;
+    for(upage = old_end; upage < new_end; upage += PGSIZE)
+      vm_spage_table_install(spt, ZERO, upage, NULL, 0, NULL, 0, 0, 0, true);
+  }
+  for(upage = new_end; upage < old_end; upage += PGSIZE){
+    struct spage* sp = lookup_spage(spt, upage);
 
-  if(sp->type == FRAME){
-    vm_frame_pinning(sp->kpage);
+    if(sp == NULL) continue;
+    discard_page(spt, pagedir, sp);
+    hash_delete(&spt->page_hash, &sp->elem);
+    free(sp);
   }
 
+  spt->brk = new;
+  return old;
+}
+
+void vm_spage_table_mm_unmap(struct spage_table* spt, uint32_t* pagedir, void* page, struct file* f, off_t offset, size_t bytes){ 
+  struct spage* sp = lookup_spage(spt, page);
+
+  if(sp == NULL) return;
+  // Fails if the page went to swap meanwhile
+  if(sp->type == FRAME) vm_frame_pin_page(sp);
+
   switch(sp->type){
     case ZERO:
       break;
@@ -118,8 +560,9 @@ void vm_spage_table_mm_unmap(struct spage_table* spt, uint32_t* pagedir, void* p
     case FRAME:
       if(sp->dirty || pagedir_is_dirty(pagedir, sp->upage) || pagedir_is_dirty(pagedir, sp->kpage))
 	file_write_at (f, sp->upage, bytes, offset);
-      vm_frame_deallocate(sp->kpage, true);
       pagedir_clear_page(pagedir, sp->upage);
+      vm_frame_release(sp->kpage, thread_current(), sp->upage);
+      vm_spage_drop_swap_slot(sp);
       break;
 
     case SWAP:
@@ -138,4 +581,97 @@ void vm_spage_table_mm_unmap(struct spage_table* spt, uint32_t* pagedir, void* p
   }
 
   hash_delete(&spt->page_hash, &sp->elem);
+  free(sp);
+}
+
+// Handles a write fault on UPAGE, which is present but read-only.
+// Returns false unless UPAGE is a writable page shared copy-on-write
+// or mapped to the zero page.
+bool vm_cow_page(struct spage_table* spt, void* upage){
+  struct spage* sp = vm_find_spage(spt, upage);
+  uint32_t* pagedir = thread_current()->pagedir;
+
+  if(sp == NULL || !sp->writable) return false;
+  if(sp->type == ZERO){
+    pagedir_clear_page(pagedir, upage);
+    return vm_load_page(spt, pagedir, upage, true, NULL);
+  }
+  // Evicted since the fault: the retried write faults it back in
+  if(sp->type != FRAME) return true;
+
+  return vm_frame_copy_on_write(thread_current(), upage, sp->kpage);
+}
+
+// Copies the pages of PARENT into CHILD, whose table is still empty, for
+// fork().  Resident pages are shared copy-on-write, swapped pages share
+// their swap slot, and pages not loaded yet are copied as they are.
+// The locks of both tables must be held.
+// Returns false if memory ran out.
+bool vm_spage_table_fork(struct thread* parent, struct thread* child){
+  struct hash_iterator i;
+
+  ASSERT(lock_held_by_current_thread(&parent->spt->lock));
+  ASSERT(lock_held_by_current_thread(&child->spt->lock));
+  if(!vm_region_copy(parent->spt->regions, &child->spt->regions)) return false;
+  child->spt->heap_start = parent->spt->heap_start;
+  child->spt->brk = parent->spt->brk;
+
+  hash_first(&i, &parent->spt->page_hash);
+  while(hash_next(&i)){
+    struct spage* psp = hash_entry(hash_cur(&i), struct spage, elem);
+    struct spage* csp = malloc(sizeof *csp);
+
+    if(csp == NULL) return false;
+
+    // PARENT is blocked in fork(), so only eviction can change its pages.
+    // A swap slot PARENT kept after swap-in stays PARENT's.
+    for(;;){
+      *csp = *psp;
+      csp->swap_cached = false;
+      hash_insert(&child->spt->page_hash, &csp->elem);
+      if(psp->type == FRAME){
+        csp->dirty = psp->dirty || pagedir_is_dirty(parent->pagedir, psp->upage);
+        if(vm_frame_share(psp->kpage, parent, child, csp)) break;
+        hash_delete(&child->spt->page_hash, &csp->elem);
+        if(psp->type == FRAME){
+          free(csp);
+          return false;
+        }
+        continue;
+      }
+      if(psp->type == SWAP && !vm_swap_dup(psp->sector_index)){
+        hash_delete(&child->spt->page_hash, &csp->elem);
+        free(csp);
+        return false;
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+struct replace_file_args{
+  struct file* old;
+  struct file* new;
+};
+
+static void replace_region_file(struct vm_region* r, void* aux){
+  struct replace_file_args* args = aux;
+
+  if(r->file == args->old) r->file = args->new;
+}
+
+// Makes the pages of SPT that are read from OLD read from NEW instead.
+void vm_spage_table_replace_file(struct spage_table* spt, struct file* old, struct file* new){
+  struct replace_file_args args = { old, new };
+  struct hash_iterator i;
+
+  ASSERT(lock_held_by_current_thread(&spt->lock));
+  vm_region_for_each(spt->regions, replace_region_file, &args);
+
+  hash_first(&i, &spt->page_hash);
+  while(hash_next(&i)){
+    struct spage* sp = hash_entry(hash_cur(&i), struct spage, elem);
+    if(sp->file == old) sp->file = new;
+  }
 }
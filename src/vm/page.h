@@ -8,9 +8,15 @@
 #include "threads/synch.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "vm/frame.h"
+#include "vm/region.h"
+#include <vmstat.h>
+
+// Largest size the user stack may grow to
+#define MAX_STACK_SIZE 0x800000
 
 enum page_type{
   FRAME,
@@ -19,8 +25,31 @@ enum page_type{
   FILE_SYS
 };
 
+// The owner holds LOCK while it looks up or changes its pages and
+// regions.  The evictor reaches pages through their frames instead, and
+// only takes LOCK, without waiting, to delete an entry.
 struct spage_table{
-  struct hash page_hash;
+  struct lock lock;
+  struct hash page_hash;    // Pages faulted in, swapped, or stack
+  struct vm_region* regions;  // File-backed ranges, by address
+
+  // Fault-around state for FILE_SYS faults
+  void* fault_next;     // Page just past the last run read in
+  size_t fault_window;  // Pages to read on the next fault
+
+  struct vmstat_faults faults;  // Faults of the process
+
+  // Heap: anonymous pages from heap_start, which is page-aligned, up to
+  // the program break, moved by sbrk()
+  uint8_t* heap_start;
+  uint8_t* brk;
+
+  // Resident set: frames the process is the first user of
+  size_t rss;
+  size_t rss_peak;         // Largest rss so far
+  size_t rss_hand;         // Clock hand for evicting its own frames
+  unsigned rss_evict_cnt;  // Own frames evicted to keep within rss_limit
+  uint16_t pt_rss[LOADER_PHYS_BASE / PTSPAN];  // Of rss, frames under each page table
 };
 
 struct spage{
@@ -34,23 +63,42 @@ struct spage{
   bool dirty;
 
   uint32_t sector_index;
+  bool swap_cached;  // FRAME page still held by its swap slot, sector_index
 
   struct file* file;
   off_t offset;
   uint32_t read_bytes, zero_bytes;
   bool writable;
+  bool mmap;  // Part of a mmap() region
+  bool sequential;  // madvise(MADV_SEQUENTIAL)
+  uint32_t evicted_at;  // Eviction sequence number, 0 if not evicted
 };
 
 struct spage_table* vm_spage_table_create (void);
+void vm_page_init(void);
 void vm_spage_table_destroy (struct spage_table* spt);
+bool vm_spage_table_lock (struct spage_table* spt);
+void vm_spage_table_unlock (struct spage_table* spt, bool locked);
 
 void vm_spage_table_install(struct spage_table* spt, enum page_type type, 
 		void* upage, void* kpage, uint32_t sector_index, struct file* file, 
 		off_t offset, uint32_t read_bytes, uint32_t zero_bytes, bool writable);
 
 struct spage* vm_find_spage (struct spage_table* spt, void* upage);
-bool vm_load_page(struct spage_table* spt, uint32_t* pagedir, void* upage);
+void vm_spage_drop_swap_slot (struct spage* sp);
+void vm_spage_table_forget (struct spage_table* spt, struct spage* sp);
+bool vm_spage_table_map(struct spage_table* spt, void* upage, size_t length,
+		struct file* file, off_t offset, size_t read_bytes, bool writable, bool mmap);
+void vm_spage_table_unmap(struct spage_table* spt, void* upage);
+size_t vm_spage_table_resident (struct spage_table* spt);
+bool vm_load_page(struct spage_table* spt, uint32_t* pagedir, void* upage, bool write, bool* text_hit);
+bool vm_cow_page(struct spage_table* spt, void* upage);
+bool vm_spage_table_fork(struct thread* parent, struct thread* child);
+void vm_spage_table_replace_file(struct spage_table* spt, struct file* old, struct file* new);
 
+bool vm_spage_table_advise(struct spage_table* spt, uint32_t* pagedir, void* addr, size_t len, int advice);
+void* vm_spage_table_sbrk(struct spage_table* spt, uint32_t* pagedir, intptr_t increment);
+void vm_spage_table_mm_sync(struct spage_table* spt, uint32_t* pagedir, void* page, struct file* f, off_t offset, size_t bytes);
 void vm_spage_table_mm_unmap(struct spage_table* spt, uint32_t* pagedir, void* page, struct file* f, off_t offset, size_t bytes);
 
 #endif
@@ -0,0 +1,153 @@
+#include "vm/region.h"
+#include "threads/malloc.h"
+
+static int height(struct vm_region* r){
+  return r != NULL ? r->height : 0;
+}
+
+static void update(struct vm_region* r){
+  int l = height(r->left), h = height(r->right);
+  r->height = (l > h ? l : h) + 1;
+}
+
+static struct vm_region* rotate_right(struct vm_region* r){
+  struct vm_region* l = r->left;
+
+  r->left = l->right;
+  l->right = r;
+  update(r);
+  update(l);
+  return l;
+}
+
+static struct vm_region* rotate_left(struct vm_region* r){
+  struct vm_region* h = r->right;
+
+  r->right = h->left;
+  h->left = r;
+  update(r);
+  update(h);
+  return h;
+}
+
+// Restores the AVL invariant at R, whose subtrees are balanced and
+// differ in height by at most two.  Returns the new root of the subtree.
+static struct vm_region* rebalance(struct vm_region* r){
+  int balance;
+
+  update(r);
+  balance = height(r->left) - height(r->right);
+  if(balance > 1){
+    if(height(r->left->left) < height(r->left->right)) r->left = rotate_left(r->left);
+    return rotate_right(r);
+  }
+  if(balance < -1){
+    if(height(r->right->right) < height(r->right->left)) r->right = rotate_right(r->right);
+    return rotate_left(r);
+  }
+  return r;
+}
+
+static struct vm_region* insert(struct vm_region* root, struct vm_region* r){
+  if(root == NULL) return r;
+  if(r->start < root->start) root->left = insert(root->left, r);
+  else root->right = insert(root->right, r);
+  return rebalance(root);
+}
+
+// Inserts R, which must not overlap any region in the tree at *ROOT.
+void vm_region_insert(struct vm_region** root, struct vm_region* r){
+  r->left = r->right = NULL;
+  r->height = 1;
+  *root = insert(*root, r);
+}
+
+// Unlinks the leftmost region of the subtree at ROOT into *MIN.
+// Returns the new root of the subtree.
+static struct vm_region* remove_min(struct vm_region* root, struct vm_region** min){
+  if(root->left == NULL){
+    *min = root;
+    return root->right;
+  }
+  root->left = remove_min(root->left, min);
+  return rebalance(root);
+}
+
+static struct vm_region* remove_region(struct vm_region* root, struct vm_region* r){
+  if(root == NULL) return NULL;
+  if(r->start < root->start) root->left = remove_region(root->left, r);
+  else if(r->start > root->start) root->right = remove_region(root->right, r);
+  else{
+    struct vm_region* next;
+
+    if(root->right == NULL) return root->left;
+    root->right = remove_min(root->right, &next);
+    next->left = root->left;
+    next->right = root->right;
+    root = next;
+  }
+  return rebalance(root);
+}
+
+// Unlinks R from the tree at *ROOT.  R is not freed.
+void vm_region_remove(struct vm_region** root, struct vm_region* r){
+  *root = remove_region(*root, r);
+}
+
+// Returns the region containing ADDR, or NULL if there is none.
+struct vm_region* vm_region_find(struct vm_region* root, const void* addr){
+  const uint8_t* a = addr;
+
+  while(root != NULL){
+    if(a < root->start) root = root->left;
+    else if(a >= root->end) root = root->right;
+    else return root;
+  }
+  return NULL;
+}
+
+// Returns true if some region intersects [START, END).
+bool vm_region_overlaps(struct vm_region* root, const void* start, const void* end){
+  const uint8_t* s = start;
+  const uint8_t* e = end;
+
+  while(root != NULL){
+    if(e <= root->start) root = root->left;
+    else if(s >= root->end) root = root->right;
+    else return true;
+  }
+  return false;
+}
+
+// Makes *DST, an empty tree, a copy of the tree at SRC.
+// Returns false if memory ran out; what was copied is left in *DST.
+bool vm_region_copy(struct vm_region* src, struct vm_region** dst){
+  struct vm_region* r;
+
+  if(src == NULL) return true;
+  r = malloc(sizeof *r);
+  if(r == NULL) return false;
+  *r = *src;
+  r->left = r->right = NULL;
+  *dst = r;
+  return vm_region_copy(src->left, &r->left) && vm_region_copy(src->right, &r->right);
+}
+
+// Frees every region of the tree at *ROOT and empties it.
+void vm_region_destroy(struct vm_region** root){
+  struct vm_region* r = *root;
+
+  if(r == NULL) return;
+  vm_region_destroy(&r->left);
+  vm_region_destroy(&r->right);
+  free(r);
+  *root = NULL;
+}
+
+// Calls FUNC with AUX for each region of the tree at ROOT, in order.
+void vm_region_for_each(struct vm_region* root, void (*func)(struct vm_region*, void*), void* aux){
+  if(root == NULL) return;
+  vm_region_for_each(root->left, func, aux);
+  func(root, aux);
+  vm_region_for_each(root->right, func, aux);
+}
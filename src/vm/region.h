@@ -0,0 +1,36 @@
+#ifndef VM_REGION_H
+#define VM_REGION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+// Range of an address space mapped from a file (segments of the
+// executable, mmap() regions), whose pages get supplemental page table
+// entries only once they are faulted in
+struct vm_region{
+  uint8_t* start;       // First page
+  uint8_t* end;         // Just past the last page
+
+  struct file* file;
+  off_t offset;         // File offset of START
+  size_t read_bytes;    // Bytes read from FILE; the rest is zeroed
+  bool writable;
+  bool mmap;            // A mmap() region
+
+  // AVL tree by START
+  struct vm_region* left;
+  struct vm_region* right;
+  int height;
+};
+
+void vm_region_insert(struct vm_region** root, struct vm_region* r);
+void vm_region_remove(struct vm_region** root, struct vm_region* r);
+struct vm_region* vm_region_find(struct vm_region* root, const void* addr);
+bool vm_region_overlaps(struct vm_region* root, const void* start, const void* end);
+bool vm_region_copy(struct vm_region* src, struct vm_region** dst);
+void vm_region_destroy(struct vm_region** root);
+void vm_region_for_each(struct vm_region* root, void (*func)(struct vm_region*, void*), void* aux);
+
+#endif
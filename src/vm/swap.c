@@ -1,37 +1,138 @@
 #include "vm/swap.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "vm/zswap.h"
+
+// Sectors per swap slot
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+// Slots reserved at once, so that pages evicted one after another
+// land next to each other on the device
+#define SWAP_CLUSTER 16
 
 static struct block* swap_block;
-static struct bitmap* swap_bitmap;
+static struct bitmap* swap_bitmap;  // One bit per slot, true if free
+static uint16_t* slot_refs;          // Pages referring to each used slot
+static struct lock swap_lock;
+
+// Next slot of the current cluster, and how many slots it has left
+static size_t cluster_next;
+static size_t cluster_left;
 
 void vm_swap_init(){
+  size_t slot_cnt = 0;
+
+  lock_init(&swap_lock);
   swap_block = block_get_role(BLOCK_SWAP); 
-  swap_bitmap = bitmap_create(1024);
+  if(swap_block != NULL) slot_cnt = block_size(swap_block) / SECTORS_PER_PAGE;
+  if(slot_cnt == 0) return;
 
+  swap_bitmap = bitmap_create(slot_cnt);
+  if(swap_bitmap == NULL) PANIC("swap: out of memory for %zu slots", slot_cnt);
   bitmap_set_all(swap_bitmap, true);
+  slot_refs = calloc(slot_cnt, sizeof *slot_refs);
+  if(slot_refs == NULL) PANIC("swap: out of memory for %zu slots", slot_cnt);
+
+  vm_zswap_init();
 }
 
-uint32_t vm_swap_out(void* page){
-  size_t sector_index = bitmap_scan(swap_bitmap, 0, 1, true);
-  size_t i;
+// Takes a free slot out of the bitmap. swap_lock must be held.
+// Slots come from the current cluster while it lasts; a new cluster is
+// the next run of SWAP_CLUSTER free slots after it, wrapping around.
+// When swap is too fragmented for that, any free slot is used.
+static size_t alloc_slot(void){
+  size_t slot;
 
-  for(i = 0; i < 8; i++){
-    block_write(swap_block, sector_index * 8 + i, page + (512 * i));
+  if(swap_bitmap == NULL) PANIC("swap: no swap device");
+
+  if(cluster_left == 0 || !bitmap_test(swap_bitmap, cluster_next)){
+    cluster_left = SWAP_CLUSTER;
+    cluster_next = bitmap_scan(swap_bitmap, cluster_next, SWAP_CLUSTER, true);
+    if(cluster_next == BITMAP_ERROR)
+      cluster_next = bitmap_scan(swap_bitmap, 0, SWAP_CLUSTER, true);
+    if(cluster_next == BITMAP_ERROR){
+      cluster_left = 1;
+      cluster_next = bitmap_scan(swap_bitmap, 0, 1, true);
+      if(cluster_next == BITMAP_ERROR) PANIC("swap: out of swap slots");
+    }
   }
-  bitmap_set(swap_bitmap, sector_index, false);
+  slot = cluster_next++;
+  cluster_left--;
+  bitmap_reset(swap_bitmap, slot);
+  slot_refs[slot] = 1;
 
-  return sector_index;
+  return slot;
 }
 
-void vm_swap_in (uint32_t sector_index, void* page){
-  size_t i;
-  
-  for(i = 0; i < 8; ++i){
-    block_read(swap_block, sector_index * 8 + i, page + (512 * i));
-  }
+uint32_t vm_swap_out(void* page){
+  size_t slot;
+
+  lock_acquire(&swap_lock);
+  slot = alloc_slot();
+  lock_release(&swap_lock);
+
+  if(!vm_zswap_store(slot, page)) vm_swap_write_slot(slot, page);
+  return slot;
+}
+
+// Writes PAGE to swap slot SLOT on the device as one request.
+void vm_swap_write_slot(size_t slot, const void* page){
+  block_write_multiple(swap_block, slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE, page);
+}
 
+void vm_swap_in (uint32_t sector_index, void* page){
+  vm_swap_read(sector_index, page);
   vm_swap_free(sector_index);
 }
 
+// Reads the page of the slot into PAGE, keeping the caller's reference,
+// so that the page can be evicted to the same slot again while clean.
+void vm_swap_read (uint32_t sector_index, void* page){
+  if(!vm_zswap_load(sector_index, page))
+    block_read_multiple(swap_block, sector_index * SECTORS_PER_PAGE, SECTORS_PER_PAGE, page);
+}
+
+// Adds a reference to the slot, for a page shared copy-on-write that
+// was evicted once for all of its processes.  Returns false, adding
+// none, if the slot has as many references as it can count.
+bool vm_swap_dup (uint32_t sector_index){
+  bool success = false;
+
+  lock_acquire(&swap_lock);
+  ASSERT(slot_refs[sector_index] > 0);
+  if(slot_refs[sector_index] < UINT16_MAX){
+    slot_refs[sector_index]++;
+    success = true;
+  }
+  lock_release(&swap_lock);
+  return success;
+}
+
+// Drops a reference to the slot, freeing it with the last one.
 void vm_swap_free (uint32_t sector_index){
-  bitmap_set(swap_bitmap, sector_index, true);
+  lock_acquire(&swap_lock);
+  ASSERT(slot_refs[sector_index] > 0);
+  if(--slot_refs[sector_index] == 0){
+    vm_zswap_invalidate(sector_index);
+    bitmap_set(swap_bitmap, sector_index, true);
+  }
+  lock_release(&swap_lock);
+}
+
+void vm_swap_get_meminfo(struct meminfo* info){
+  if(swap_bitmap == NULL){
+    info->swap_total = info->swap_used = 0;
+    return;
+  }
+  info->swap_total = bitmap_size(swap_bitmap);
+  info->swap_used = bitmap_count(swap_bitmap, 0, info->swap_total, false);
+}
+
+void vm_swap_print_stats(void){
+  struct meminfo info;
+
+  vm_swap_get_meminfo(&info);
+  printf("Swap: %zu of %zu slots used\n", info.swap_used, info.swap_total);
 }
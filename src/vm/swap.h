@@ -2,13 +2,19 @@
 #define VM_SWAP_H
 
 #include <bitmap.h>
+#include <meminfo.h>
 #include "threads/vaddr.h"
 #include "devices/block.h"
 #include "vm/swap.h"
 
 void vm_swap_init();
 uint32_t vm_swap_out(void* page);
+void vm_swap_write_slot(size_t slot, const void* page);
 void vm_swap_in(uint32_t sector_index, void* page);
+void vm_swap_read(uint32_t sector_index, void* page);
+bool vm_swap_dup(uint32_t sector_index);
 void vm_swap_free(uint32_t sector_index);
+void vm_swap_get_meminfo(struct meminfo* info);
+void vm_swap_print_stats(void);
 
 #endif
@@ -0,0 +1,130 @@
+#include "vm/vmstat.h"
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+
+static struct vmstat stats;
+
+// Memory use of the last EXIT_RECORDS processes to exit, oldest first
+// from exit_next once the ring has filled
+#define EXIT_RECORDS 32
+static struct exit_record{
+  char name[16];
+  int tid;
+  size_t resident;   // Pages resident at exit
+  size_t rss_peak;   // Most frames charged to it at once
+} exit_records[EXIT_RECORDS];
+static unsigned exit_cnt;
+
+static const char* fault_names[VMSTAT_FAULT_CNT] = {
+  "zero", "swap", "file", "stack", "cow", "minor", "kill"
+};
+
+static const char* evict_names[VMSTAT_EVICT_CNT] = {
+  "anon", "file", "text"
+};
+
+// Returns the histogram bucket of a fault that took CYCLES.
+static size_t hist_bucket(uint64_t cycles){
+  size_t b = 0;
+
+  cycles >>= VMSTAT_HIST_SHIFT;
+  while(cycles != 0 && b < VMSTAT_HIST_BUCKETS - 1){
+    cycles >>= 1;
+    b++;
+  }
+  return b;
+}
+
+static void add_fault(struct vmstat_faults* faults, enum vmstat_fault type, size_t bucket){
+  faults->cnt[type]++;
+  faults->hist[type][bucket]++;
+}
+
+// Records a fault of TYPE that began at START, by vm_stat_clock(), for
+// the process whose counters are PROCESS, if any, and globally.
+void vm_stat_fault(struct vmstat_faults* process, enum vmstat_fault type, uint64_t start){
+  size_t bucket = hist_bucket(vm_stat_clock() - start);
+  enum intr_level old_level = intr_disable();
+
+  if(process != NULL) add_fault(process, type, bucket);
+  add_fault(&stats.global, type, bucket);
+  intr_set_level(old_level);
+}
+
+// Records the eviction of a page of TYPE, DIRTY or not, chosen after
+// the clock looked at SCANNED frames, and made to keep a process within
+// its resident limit if RSS.  frame_lock is held.
+void vm_stat_evict(enum vmstat_evict type, bool dirty, size_t scanned, bool rss){
+  stats.evict_cnt[type]++;
+  if(dirty) stats.evict_dirty++;
+  if(rss) stats.rss_evict_global++;
+  stats.clock_scanned += scanned;
+  if(scanned > stats.clock_scan_max) stats.clock_scan_max = scanned;
+}
+
+// Records that the process NAME, TID, exits with RESIDENT pages
+// resident, having had at most RSS_PEAK frames charged to it.
+void vm_stat_exit(const char* name, int tid, size_t resident, size_t rss_peak){
+  enum intr_level old_level = intr_disable();
+  struct exit_record* r = &exit_records[exit_cnt++ % EXIT_RECORDS];
+
+  strlcpy(r->name, name, sizeof r->name);
+  r->tid = tid;
+  r->resident = resident;
+  r->rss_peak = rss_peak;
+  intr_set_level(old_level);
+}
+
+// Returns the number of faults so far, of all processes, that read
+// their page from swap or from a file.
+unsigned vm_stat_major_faults(void){
+  return stats.global.cnt[VMSTAT_FAULT_SWAP] + stats.global.cnt[VMSTAT_FAULT_FILE];
+}
+
+// Fills in INFO, with PROCESS as the calling process's fault counters.
+void vm_stat_get(const struct vmstat_faults* process, struct vmstat* info){
+  enum intr_level old_level = intr_disable();
+
+  *info = stats;
+  if(process != NULL) info->process = *process;
+  else memset(&info->process, 0, sizeof info->process);
+  intr_set_level(old_level);
+}
+
+static void print_faults(const struct vmstat_faults* faults){
+  size_t t, b;
+
+  for(t = 0; t < VMSTAT_FAULT_CNT; t++){
+    if(faults->cnt[t] == 0) continue;
+    printf("  %-5s %u:", fault_names[t], faults->cnt[t]);
+    for(b = 0; b < VMSTAT_HIST_BUCKETS; b++)
+      if(faults->hist[t][b] != 0)
+        printf(" <2^%zu %u", b + VMSTAT_HIST_SHIFT, faults->hist[t][b]);
+    printf("\n");
+  }
+}
+
+// Prints fault counts with their latency histograms, in cycles,
+// eviction counts, and the memory use of the last processes to exit.
+void vm_stat_print(void){
+  unsigned i;
+  size_t t;
+
+  printf("VM faults (latency in cycles):\n");
+  print_faults(&stats.global);
+
+  printf("VM evictions:");
+  for(t = 0; t < VMSTAT_EVICT_CNT; t++)
+    printf(" %u %s,", stats.evict_cnt[t], evict_names[t]);
+  printf(" %u dirty; clock scanned %llu frames, at most %u\n",
+         stats.evict_dirty, stats.clock_scanned, stats.clock_scan_max);
+  printf("VM evictions within resident limits: %u\n", stats.rss_evict_global);
+
+  printf("VM processes exited: %u\n", exit_cnt);
+  for(i = exit_cnt > EXIT_RECORDS ? exit_cnt - EXIT_RECORDS : 0; i < exit_cnt; i++){
+    struct exit_record* r = &exit_records[i % EXIT_RECORDS];
+    printf("  %s (%d): %zu pages resident at exit, peak rss %zu\n",
+           r->name, r->tid, r->resident, r->rss_peak);
+  }
+}
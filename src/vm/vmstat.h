@@ -0,0 +1,23 @@
+#ifndef VM_VMSTAT_H
+#define VM_VMSTAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vmstat.h>
+
+// CPU cycles since boot, for timing faults
+static inline uint64_t vm_stat_clock(void){
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+void vm_stat_fault(struct vmstat_faults* process, enum vmstat_fault type, uint64_t start);
+void vm_stat_evict(enum vmstat_evict type, bool dirty, size_t scanned, bool rss);
+void vm_stat_exit(const char* name, int tid, size_t resident, size_t rss_peak);
+unsigned vm_stat_major_faults(void);
+void vm_stat_get(const struct vmstat_faults* process, struct vmstat* info);
+void vm_stat_print(void);
+
+#endif
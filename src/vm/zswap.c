@@ -0,0 +1,410 @@
+#include "vm/zswap.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/swap.h"
+
+// Compressed swap cache.
+//
+// vm_swap_out() offers every page to vm_zswap_store() before writing it
+// to its slot on the swap device.  Pages that compress well are kept in
+// a pool of kernel pages instead, and vm_swap_in() gets them back from
+// vm_zswap_load() without any disk I/O.  The slot stays reserved on the
+// device, so a page can be written back to it at any time, and the page
+// leaves the pool when the slot is freed.
+//
+// The pool is a log: compressed pages are appended at the tail, and
+// when there is no room the oldest pages are decompressed and written
+// to their slots until there is.  Freed pages leave holes that are
+// reused once the oldest page moves past them.
+//
+// A page is written back without zswap_lock: it is taken off the log,
+// so that its room can be reused, and decompressed into pbuf, from which
+// loads copy it until the write is done.  There is one pbuf, so one
+// writeback at a time.  Freeing the slot waits for it to finish, lest
+// the slot be reused and then overwritten.
+//
+// The codec is a byte-oriented LZ77 in the style of LZ4.  A compressed
+// page is a series of sequences, each a token byte whose high nibble is
+// a literal count and low nibble a match length minus LZ_MIN_MATCH, the
+// literals, a 2-byte little-endian match offset and, for nibbles of 15,
+// extra length bytes of up to 255 each.  The last sequence has literals
+// only.
+
+// A compressed page.
+struct zentry{
+  struct hash_elem elem;       // Element in zswap_hash
+  struct list_elem log_elem;   // Element in zswap_log, oldest first
+  size_t slot;                 // Swap slot of the page
+  size_t ofs;                  // Offset in pool
+  size_t size;                 // Compressed size
+  bool writeback;              // Off the log, being written from pbuf
+};
+
+// Pages compressing to more than this go straight to the device
+#define MAX_STORE (PGSIZE * 3 / 4)
+
+// Default pool size limit, in pages
+#define DEFAULT_POOL_PAGES 256
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+// -zswap=PAGES: pool size, 0 to disable, SIZE_MAX for the default of
+// 1/8 of the kernel pool up to DEFAULT_POOL_PAGES
+size_t vm_zswap_pool_pages = SIZE_MAX;
+
+static struct lock zswap_lock;
+static struct hash zswap_hash;   // Compressed pages by slot
+static struct list zswap_log;    // Compressed pages, oldest first
+
+static uint8_t* pool;            // Log of compressed pages
+static size_t pool_size;         // Bytes in pool, 0 if disabled
+static size_t tail;              // Offset where the next page goes
+
+static uint8_t* zbuf;            // Compression output
+static uint8_t* pbuf;            // Page decompressed for writeback
+static bool pbuf_busy;           // A writeback is using pbuf
+static struct condition writeback_done;
+static uint16_t lz_table[1 << LZ_HASH_BITS];  // Match finder
+
+// Statistics
+static size_t live_bytes;
+static unsigned long long store_cnt, reject_cnt, load_cnt, writeback_cnt;
+
+static unsigned hash_func(const struct hash_elem* elem, void* aux UNUSED){
+  struct zentry* e = hash_entry(elem, struct zentry, elem);
+  return hash_int((int)e->slot);
+}
+
+static bool less_func(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED){
+  return hash_entry(a, struct zentry, elem)->slot < hash_entry(b, struct zentry, elem)->slot;
+}
+
+static uint32_t read32(const uint8_t* p){
+  uint32_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+static unsigned lz_hash(uint32_t v){
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Writes the extra length bytes for LEN past a nibble of 15.
+static uint8_t* lz_put_len(uint8_t* op, size_t len){
+  for(; len >= 255; len -= 255) *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+// Appends to *OPP a sequence of LIT_LEN literals at LIT followed, if
+// MATCH_LEN is nonzero, by a match of MATCH_LEN bytes OFFSET back.
+// Returns false if it would run past OEND.
+static bool lz_emit(uint8_t** opp, uint8_t* oend, const uint8_t* lit, size_t lit_len,
+                    size_t offset, size_t match_len){
+  uint8_t* op = *opp;
+  size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+  uint8_t* token;
+
+  if((size_t)(oend - op) < 1 + lit_len / 255 + 1 + lit_len + 2 + ml / 255 + 1) return false;
+
+  token = op++;
+  *token = (lit_len < 15 ? lit_len : 15) << 4;
+  if(lit_len >= 15) op = lz_put_len(op, lit_len - 15);
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+
+  if(match_len){
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    *token |= ml < 15 ? ml : 15;
+    if(ml >= 15) op = lz_put_len(op, ml - 15);
+  }
+  *opp = op;
+  return true;
+}
+
+// Compresses the N bytes at SRC into DST. Returns the compressed size,
+// or 0 if it would exceed CAP. zswap_lock must be held for lz_table.
+static size_t lz_compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap){
+  const uint8_t* ip = src;
+  const uint8_t* anchor = src;
+  const uint8_t* end = src + n;
+  uint8_t* op = dst;
+
+  memset(lz_table, 0, sizeof lz_table);
+  while(end - ip >= LZ_MIN_MATCH){
+    uint32_t v = read32(ip);
+    unsigned h = lz_hash(v);
+    const uint8_t* ref = src + lz_table[h];
+    size_t len;
+
+    lz_table[h] = ip - src;
+    if(ref >= ip || ip - ref > UINT16_MAX || read32(ref) != v){
+      ip++;
+      continue;
+    }
+
+    for(len = LZ_MIN_MATCH; ip + len < end && ref[len] == ip[len]; len++)
+      continue;
+    if(!lz_emit(&op, dst + cap, anchor, ip - anchor, ip - ref, len)) return 0;
+    ip += len;
+    anchor = ip;
+  }
+  if(!lz_emit(&op, dst + cap, anchor, end - anchor, 0, 0)) return 0;
+
+  return op - dst;
+}
+
+// Reads extra length bytes into *LEN. Returns false past IEND.
+static bool lz_get_len(const uint8_t** ipp, const uint8_t* iend, size_t* len){
+  const uint8_t* ip = *ipp;
+  uint8_t b;
+
+  do{
+    if(ip >= iend) return false;
+    b = *ip++;
+    *len += b;
+  }while(b == 255);
+  *ipp = ip;
+  return true;
+}
+
+// Decompresses the N bytes at SRC into the CAP bytes at DST.
+// Returns false unless the output is exactly CAP bytes.
+static bool lz_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap){
+  const uint8_t* ip = src;
+  const uint8_t* iend = src + n;
+  uint8_t* op = dst;
+  uint8_t* oend = dst + cap;
+
+  while(ip < iend){
+    unsigned token = *ip++;
+    size_t len = token >> 4;
+    size_t offset;
+    const uint8_t* m;
+
+    if(len == 15 && !lz_get_len(&ip, iend, &len)) return false;
+    if(len > (size_t)(iend - ip) || len > (size_t)(oend - op)) return false;
+    memcpy(op, ip, len);
+    op += len;
+    ip += len;
+    if(ip == iend) break;
+
+    if(iend - ip < 2) return false;
+    offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    len = token & 15;
+    if(len == 15 && !lz_get_len(&ip, iend, &len)) return false;
+    len += LZ_MIN_MATCH;
+    if(offset == 0 || offset > (size_t)(op - dst) || len > (size_t)(oend - op)) return false;
+
+    // Byte by byte, since the match may overlap its own output
+    for(m = op - offset; len > 0; len--) *op++ = *m++;
+  }
+  return op == oend;
+}
+
+// Sets up the pool. Called by vm_swap_init() once swap slots exist.
+void vm_zswap_init(void){
+  size_t pages = vm_zswap_pool_pages;
+
+  lock_init(&zswap_lock);
+  cond_init(&writeback_done);
+  hash_init(&zswap_hash, hash_func, less_func, NULL);
+  list_init(&zswap_log);
+
+  if(pages == SIZE_MAX){
+    pages = palloc_free_cnt(0) / 8;
+    if(pages > DEFAULT_POOL_PAGES) pages = DEFAULT_POOL_PAGES;
+  }
+  if(pages == 0) return;
+
+  zbuf = palloc_get_page(0);
+  pbuf = palloc_get_page(0);
+  // The pool must be contiguous, so settle for less if memory is fragmented
+  for(; pages > 0 && zbuf != NULL && pbuf != NULL; pages /= 2){
+    pool = palloc_get_multiple(0, pages);
+    if(pool != NULL) break;
+  }
+  if(pool == NULL){
+    printf("zswap: not enough memory, disabled\n");
+    if(zbuf != NULL) palloc_free_page(zbuf);
+    if(pbuf != NULL) palloc_free_page(pbuf);
+    vm_zswap_pool_pages = 0;
+    return;
+  }
+  pool_size = pages * PGSIZE;
+  vm_zswap_pool_pages = pages;
+}
+
+static struct zentry* find_entry(size_t slot){
+  struct zentry temp;
+  struct hash_elem* h;
+
+  temp.slot = slot;
+  h = hash_find(&zswap_hash, &temp.elem);
+  return h != NULL ? hash_entry(h, struct zentry, elem) : NULL;
+}
+
+static void remove_entry(struct zentry* e){
+  hash_delete(&zswap_hash, &e->elem);
+  list_remove(&e->log_elem);
+  live_bytes -= e->size;
+  free(e);
+}
+
+// Returns the offset at which SIZE bytes fit in the log without reaching
+// its oldest page, or SIZE_MAX if there is no room.
+static size_t log_space(size_t size){
+  size_t head;
+
+  if(list_empty(&zswap_log)){
+    tail = 0;
+    return size <= pool_size ? 0 : SIZE_MAX;
+  }
+
+  head = list_entry(list_front(&zswap_log), struct zentry, log_elem)->ofs;
+  if(tail > head){
+    if(size <= pool_size - tail) return tail;
+    if(size < head) return 0;
+    return SIZE_MAX;
+  }
+  return size < head - tail ? tail : SIZE_MAX;
+}
+
+// Writes the oldest compressed page to its swap slot and drops it, or
+// waits for the writeback in progress if there is one.  zswap_lock must
+// be held; it is released during the write, so callers check the log
+// again afterwards.
+static void writeback_oldest(void){
+  struct zentry* e;
+
+  if(pbuf_busy){
+    cond_wait(&writeback_done, &zswap_lock);
+    return;
+  }
+
+  e = list_entry(list_front(&zswap_log), struct zentry, log_elem);
+  if(!lz_decompress(pool + e->ofs, e->size, pbuf, PGSIZE))
+    PANIC("zswap: corrupt page for slot %zu", e->slot);
+  list_remove(&e->log_elem);
+  live_bytes -= e->size;
+  e->writeback = true;
+  pbuf_busy = true;
+  lock_release(&zswap_lock);
+
+  vm_swap_write_slot(e->slot, pbuf);
+
+  lock_acquire(&zswap_lock);
+  hash_delete(&zswap_hash, &e->elem);
+  free(e);
+  pbuf_busy = false;
+  writeback_cnt++;
+  cond_broadcast(&writeback_done, &zswap_lock);
+}
+
+// Compresses PAGE, which belongs in swap slot SLOT, into the pool,
+// writing back older pages if needed to make room.
+// Returns false if the page should go to the device instead.
+bool vm_zswap_store(size_t slot, const void* page){
+  struct zentry* e;
+  size_t size, ofs;
+
+  if(pool_size == 0) return false;
+
+  e = malloc(sizeof *e);
+  if(e == NULL) return false;
+
+  lock_acquire(&zswap_lock);
+  size = lz_compress(page, PGSIZE, zbuf, MAX_STORE);
+  if(size == 0){
+    reject_cnt++;
+    lock_release(&zswap_lock);
+    free(e);
+    return false;
+  }
+
+  // zbuf is free for others while a writeback lets go of the lock
+  while((ofs = log_space(size)) == SIZE_MAX){
+    writeback_oldest();
+    size = lz_compress(page, PGSIZE, zbuf, MAX_STORE);
+  }
+  memcpy(pool + ofs, zbuf, size);
+  tail = ofs + size;
+
+  e->slot = slot;
+  e->ofs = ofs;
+  e->size = size;
+  e->writeback = false;
+  hash_insert(&zswap_hash, &e->elem);
+  list_push_back(&zswap_log, &e->log_elem);
+  live_bytes += size;
+  store_cnt++;
+  lock_release(&zswap_lock);
+
+  return true;
+}
+
+// Decompresses the page of swap slot SLOT into PAGE. The compressed copy
+// stays until the slot is freed, since other processes sharing the slot
+// may still load it. Returns false if the page is not in the pool.
+bool vm_zswap_load(size_t slot, void* page){
+  struct zentry* e;
+
+  if(pool_size == 0) return false;
+
+  lock_acquire(&zswap_lock);
+  e = find_entry(slot);
+  if(e == NULL){
+    lock_release(&zswap_lock);
+    return false;
+  }
+  if(e->writeback) memcpy(page, pbuf, PGSIZE);
+  else if(!lz_decompress(pool + e->ofs, e->size, page, PGSIZE))
+    PANIC("zswap: corrupt page for slot %zu", slot);
+  load_cnt++;
+  lock_release(&zswap_lock);
+
+  return true;
+}
+
+// Drops the page of swap slot SLOT from the pool, if it is there.  If
+// it is being written back, waits for that to finish.
+void vm_zswap_invalidate(size_t slot){
+  struct zentry* e;
+
+  if(pool_size == 0) return;
+
+  lock_acquire(&zswap_lock);
+  while((e = find_entry(slot)) != NULL && e->writeback)
+    cond_wait(&writeback_done, &zswap_lock);
+  if(e != NULL) remove_entry(e);
+  lock_release(&zswap_lock);
+}
+
+// Fills in the compressed swap fields of INFO.
+// zswap_lock is not taken because this also runs on the panic path.
+void vm_zswap_get_meminfo(struct meminfo* info){
+  info->zswap_pool_pages = pool_size / PGSIZE;
+  info->zswap_pages = pool_size != 0 ? hash_size(&zswap_hash) : 0;
+  info->zswap_bytes = live_bytes;
+}
+
+void vm_zswap_print_stats(void){
+  struct meminfo info;
+
+  vm_zswap_get_meminfo(&info);
+  printf("Zswap: %zu pages in %zu bytes of %zu-page pool, "
+         "%llu stored, %llu rejected, %llu loaded, %llu written back\n",
+         info.zswap_pages, info.zswap_bytes, info.zswap_pool_pages,
+         store_cnt, reject_cnt, load_cnt, writeback_cnt);
+}
@@ -0,0 +1,18 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <meminfo.h>
+
+// Pages of kernel memory holding compressed swap (-zswap=PAGES)
+extern size_t vm_zswap_pool_pages;
+
+void vm_zswap_init(void);
+bool vm_zswap_store(size_t slot, const void* page);
+bool vm_zswap_load(size_t slot, void* page);
+void vm_zswap_invalidate(size_t slot);
+void vm_zswap_get_meminfo(struct meminfo* info);
+void vm_zswap_print_stats(void);
+
+#endif